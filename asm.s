@@ -1,68 +1,128 @@
-# Version 2.0
+# Version 3.0
 
 .set nobreak
 
+/**
+  * Section of the routines run on every switch: the on-chip memory when
+  * assembled with --defsym KERNEL_ONCHIP=1 (see onchip.h), else .text.
+  */
+.macro kernel_text
+.ifdef KERNEL_ONCHIP
+.section .kernel_onchip.text, "ax", @progbits
+.else
+.text
+.endif
+.endm
+
+/**
+  * Two kinds of frames are saved on the stack of a suspended process.
+  * Their first word is a tag telling which one it is, so that whatever the
+  * path that suspended a process, any path can resume it.
+  *
+  * Full frame (tag 1, 104 bytes), saved by _transfer for switches that
+  * originate in an interrupt routine:
+  *   0: tag, 4: ra, 8: fp, 12..96: r2-r23, 100: status
+  *
+  * Partial frame (tag 0, 48 bytes), saved by _transferVoluntary. At a call
+  * site the caller-saved registers are dead, so only the callee-saved ones
+  * are kept:
+  *   0: tag, 4: ra, 8: fp, 12..40: r16-r23, 44: status
+  */
+
 /**
   * Initialize the stack of a process in such a way that it can be read
   * from the transfer function.
-  * First element should be the return address.
-  * The last element is the interrupt switch status. We initialize it to 1.
-  * A pointer to the stack pointer is returned.
+  * The stack gets a partial frame whose return address is the entry point
+  * and whose interrupt switch status is initialized to 1.
+  * A pointer to the stack pointer is returned, it is the first word of the
+  * process context block at the end of the stack.
   */
 .global _createStack
 .text
 _createStack: #r4 = newSP
 			  #r5 = newPC
-			  #r6 = stackSize - 4
+			  #r6 = stackSize - sizeof(struct ProcessContext)
 	   # pointer to the bottom of the stack
 	   add r2, r4, r6
 	   # init sp with r8
-	   addi r8, r2, -100 # sp
-	   stw  r5, 0(r8)   # sp[0] = PC
+	   addi r8, r2, -48 # sp
+	   stw  r0, 0(r8)   # sp[0] = tag = partial frame
+	   stw  r5, 4(r8)   # sp[1] = PC
 	   addi r9, r0, 1
-	   stw  r9, 96(r8)  # sp[24] = status = 1
+	   stw  r9, 44(r8)  # sp[11] = status = 1
 	   # store sp on the stack bottom
 	   stw  r8, 0(r2)
 	   # return pointer to stack address
 	   ret
 
 /**
- * Context switch called from either a normal context or from an interrupt routine.
- * For those reason every registers and interrupt switch status *must* be saved.
+ * Context switch called from an interrupt routine.
+ * Every register and the interrupt switch status are saved in a full frame.
  * We use bret instruction instead of ret at the to do restore the status.
  * (eret instruction retores estatus into status register, while jumping at ea)
  */
 .global _transfer
-.text
+kernel_text
 _transfer:
-	addi sp, sp, -100
-	stw ra,  0(sp)
-    stw fp,  4(sp)
-    stw r2,  8(sp)
-    stw r3,  12(sp)
-    stw r4,  16(sp)
-    stw r5,  20(sp)
-    stw r6,  24(sp)
-    stw r7,  28(sp)
-    stw r8,  32(sp)
-    stw r9,  36(sp)
-    stw r10, 40(sp)
-    stw r11, 44(sp)
-    stw r12, 48(sp)
-    stw r13, 52(sp)
-    stw r14, 56(sp)
-    stw r15, 60(sp)
-    stw r16, 64(sp)
-    stw r17, 68(sp)
-    stw r18, 72(sp)
-    stw r19, 76(sp)
-    stw r20, 80(sp)
-    stw r21, 84(sp)
-    stw r22, 88(sp)
-    stw r23, 92(sp)
+	addi sp, sp, -104
+	stw ra,  4(sp)
+    stw fp,  8(sp)
+    stw r2,  12(sp)
+    stw r3,  16(sp)
+    stw r4,  20(sp)
+    stw r5,  24(sp)
+    stw r6,  28(sp)
+    stw r7,  32(sp)
+    stw r8,  36(sp)
+    stw r9,  40(sp)
+    stw r10, 44(sp)
+    stw r11, 48(sp)
+    stw r12, 52(sp)
+    stw r13, 56(sp)
+    stw r14, 60(sp)
+    stw r15, 64(sp)
+    stw r16, 68(sp)
+    stw r17, 72(sp)
+    stw r18, 76(sp)
+    stw r19, 80(sp)
+    stw r20, 84(sp)
+    stw r21, 88(sp)
+    stw r22, 92(sp)
+    stw r23, 96(sp)
 	# save the current interrupt switch status
     rdctl r2, status
-    stw   r2, 96(sp)
+    stw   r2, 100(sp)
+    # tag = full frame
+    addi  r2, r0, 1
+    stw   r2, 0(sp)
+    br    _switch
+
+/**
+ * Context switch called from a normal context (yield, wait, attendre...).
+ * Only the callee-saved registers and the interrupt switch status are saved
+ * in a partial frame.
+ */
+.global _transferVoluntary
+kernel_text
+_transferVoluntary:
+	addi sp, sp, -48
+	# tag = partial frame
+	stw r0,  0(sp)
+	stw ra,  4(sp)
+    stw fp,  8(sp)
+    stw r16, 12(sp)
+    stw r17, 16(sp)
+    stw r18, 20(sp)
+    stw r19, 24(sp)
+    stw r20, 28(sp)
+    stw r21, 32(sp)
+    stw r22, 36(sp)
+    stw r23, 40(sp)
+	# save the current interrupt switch status
+    rdctl r2, status
+    stw   r2, 44(sp)
+
+_switch:
     # running->sp = sp
     ldw r2, %gprel(running)(gp)
     stw sp, (r2)
@@ -71,36 +131,58 @@ _transfer:
 	stw r2, %gprel(running)(gp)
 	# set sp to the sp from the nextP
 	ldw sp, (r2)
+	# resume according to the kind of frame nextP was suspended with
+	ldw r2, 0(sp)
+	bne r2, r0, _restoreFull
 	# return using bret -> ba
-	ldw ba,  0(sp)
-    ldw fp,  4(sp)
-    ldw r2,  8(sp)
-    ldw r3,  12(sp)
-    ldw r4,  16(sp)
-    ldw r5,  20(sp)
-    ldw r6,  24(sp)
-    ldw r7,  28(sp)
-    ldw r8,  32(sp)
-    ldw r9,  36(sp)
-    ldw r10, 40(sp)
-    ldw r11, 44(sp)
-    ldw r12, 48(sp)
-    ldw r13, 52(sp)
-    ldw r14, 56(sp)
-    ldw r15, 60(sp)
-    ldw r16, 64(sp)
-    ldw r17, 68(sp)
-    ldw r18, 72(sp)
-    ldw r19, 76(sp)
-    ldw r20, 80(sp)
-    ldw r21, 84(sp)
-    ldw r22, 88(sp)
+	ldw ba,  4(sp)
+    ldw fp,  8(sp)
+    ldw r16, 12(sp)
+    ldw r17, 16(sp)
+    ldw r18, 20(sp)
+    ldw r19, 24(sp)
+    ldw r20, 28(sp)
+    ldw r21, 32(sp)
+    ldw r22, 36(sp)
+    ldw r23, 40(sp)
 	# restore interrupt switch status into bstatus
-    ldw r23, 96(sp)
+    ldw r2,  44(sp)
+    wrctl bstatus, r2
+	addi sp, sp, 48
+	# bret will copy back bstatus into status and go to ba
+	bret
+
+_restoreFull:
+	# return using bret -> ba
+	ldw ba,  4(sp)
+    ldw fp,  8(sp)
+    ldw r2,  12(sp)
+    ldw r3,  16(sp)
+    ldw r4,  20(sp)
+    ldw r5,  24(sp)
+    ldw r6,  28(sp)
+    ldw r7,  32(sp)
+    ldw r8,  36(sp)
+    ldw r9,  40(sp)
+    ldw r10, 44(sp)
+    ldw r11, 48(sp)
+    ldw r12, 52(sp)
+    ldw r13, 56(sp)
+    ldw r14, 60(sp)
+    ldw r15, 64(sp)
+    ldw r16, 68(sp)
+    ldw r17, 72(sp)
+    ldw r18, 76(sp)
+    ldw r19, 80(sp)
+    ldw r20, 84(sp)
+    ldw r21, 88(sp)
+    ldw r22, 92(sp)
+	# restore interrupt switch status into bstatus
+    ldw r23, 100(sp)
     wrctl bstatus, r23
-    ldw r23, 92(sp)
+    ldw r23, 96(sp)
 
-	addi sp, sp, 100
+	addi sp, sp, 104
 	# bret will copy back bstatus into status and go to ba
 	bret
 
@@ -119,6 +201,34 @@ allowInterrupts:
 	wrctl status, r9
 	ret
 
+.global disableInterrupts
+kernel_text
+disableInterrupts:
+	rdctl r2, status
+	wrctl status, r0
+	ret
+
+.global restoreInterrupts
+kernel_text
+restoreInterrupts: #r4 = status
+	wrctl status, r4
+	ret
+
+/**
+ * The Nios II has no instruction to wait for an interrupt: the pending
+ * ones are taken while the interrupts are allowed, then they are masked
+ * again and the caller checks whether there is something to do.
+ */
+.global waitForInterrupt
+.text
+waitForInterrupt:
+	addi r9, r0, 1
+	wrctl status, r9
+	nop
+	nop
+	wrctl status, r0
+	ret
+
 .end
 
 
@@ -4,6 +4,7 @@
 #include "system_m.h"
 
 void _transfer();
+void _transferVoluntary();
 Process _createStack(unsigned int* newSP,unsigned int* newPC,int stackSize);
 
 
@@ -0,0 +1,22 @@
+#ifndef ALTERA_AVALON_PIO_REGS_H_
+#define ALTERA_AVALON_PIO_REGS_H_
+
+/* Hosted stand-in for the PIO register map, accesses go to host/hal.c */
+
+#include "hal.h"
+
+#define ALTERA_AVALON_PIO_DATA 0
+#define ALTERA_AVALON_PIO_DIRECTION 1
+#define ALTERA_AVALON_PIO_IRQ_MASK 2
+#define ALTERA_AVALON_PIO_EDGE_CAP 3
+
+#define IORD_ALTERA_AVALON_PIO_DATA(base) host_iord(base, ALTERA_AVALON_PIO_DATA)
+#define IOWR_ALTERA_AVALON_PIO_DATA(base, data) host_iowr(base, ALTERA_AVALON_PIO_DATA, data)
+#define IORD_ALTERA_AVALON_PIO_DIRECTION(base) host_iord(base, ALTERA_AVALON_PIO_DIRECTION)
+#define IOWR_ALTERA_AVALON_PIO_DIRECTION(base, data) host_iowr(base, ALTERA_AVALON_PIO_DIRECTION, data)
+#define IORD_ALTERA_AVALON_PIO_IRQ_MASK(base) host_iord(base, ALTERA_AVALON_PIO_IRQ_MASK)
+#define IOWR_ALTERA_AVALON_PIO_IRQ_MASK(base, data) host_iowr(base, ALTERA_AVALON_PIO_IRQ_MASK, data)
+#define IORD_ALTERA_AVALON_PIO_EDGE_CAP(base) host_iord(base, ALTERA_AVALON_PIO_EDGE_CAP)
+#define IOWR_ALTERA_AVALON_PIO_EDGE_CAP(base, data) host_iowr(base, ALTERA_AVALON_PIO_EDGE_CAP, data)
+
+#endif /*ALTERA_AVALON_PIO_REGS_H_*/
@@ -0,0 +1,36 @@
+#ifndef ALTERA_AVALON_TIMER_REGS_H_
+#define ALTERA_AVALON_TIMER_REGS_H_
+
+/* Hosted stand-in for the interval timer register map, accesses go to host/hal.c */
+
+#include "hal.h"
+
+#define ALTERA_AVALON_TIMER_STATUS_REG 0
+#define ALTERA_AVALON_TIMER_CONTROL_REG 1
+#define ALTERA_AVALON_TIMER_PERIODL_REG 2
+#define ALTERA_AVALON_TIMER_PERIODH_REG 3
+#define ALTERA_AVALON_TIMER_SNAPL_REG 4
+#define ALTERA_AVALON_TIMER_SNAPH_REG 5
+
+#define ALTERA_AVALON_TIMER_STATUS_TO_MSK (0x1)
+#define ALTERA_AVALON_TIMER_STATUS_RUN_MSK (0x2)
+
+#define ALTERA_AVALON_TIMER_CONTROL_ITO_MSK (0x1)
+#define ALTERA_AVALON_TIMER_CONTROL_CONT_MSK (0x2)
+#define ALTERA_AVALON_TIMER_CONTROL_START_MSK (0x4)
+#define ALTERA_AVALON_TIMER_CONTROL_STOP_MSK (0x8)
+
+#define IORD_ALTERA_AVALON_TIMER_STATUS(base) host_iord(base, ALTERA_AVALON_TIMER_STATUS_REG)
+#define IOWR_ALTERA_AVALON_TIMER_STATUS(base, data) host_iowr(base, ALTERA_AVALON_TIMER_STATUS_REG, data)
+#define IORD_ALTERA_AVALON_TIMER_CONTROL(base) host_iord(base, ALTERA_AVALON_TIMER_CONTROL_REG)
+#define IOWR_ALTERA_AVALON_TIMER_CONTROL(base, data) host_iowr(base, ALTERA_AVALON_TIMER_CONTROL_REG, data)
+#define IORD_ALTERA_AVALON_TIMER_PERIODL(base) host_iord(base, ALTERA_AVALON_TIMER_PERIODL_REG)
+#define IOWR_ALTERA_AVALON_TIMER_PERIODL(base, data) host_iowr(base, ALTERA_AVALON_TIMER_PERIODL_REG, data)
+#define IORD_ALTERA_AVALON_TIMER_PERIODH(base) host_iord(base, ALTERA_AVALON_TIMER_PERIODH_REG)
+#define IOWR_ALTERA_AVALON_TIMER_PERIODH(base, data) host_iowr(base, ALTERA_AVALON_TIMER_PERIODH_REG, data)
+#define IORD_ALTERA_AVALON_TIMER_SNAPL(base) host_iord(base, ALTERA_AVALON_TIMER_SNAPL_REG)
+#define IOWR_ALTERA_AVALON_TIMER_SNAPL(base, data) host_iowr(base, ALTERA_AVALON_TIMER_SNAPL_REG, data)
+#define IORD_ALTERA_AVALON_TIMER_SNAPH(base) host_iord(base, ALTERA_AVALON_TIMER_SNAPH_REG)
+#define IOWR_ALTERA_AVALON_TIMER_SNAPH(base, data) host_iowr(base, ALTERA_AVALON_TIMER_SNAPH_REG, data)
+
+#endif /*ALTERA_AVALON_TIMER_REGS_H_*/
@@ -0,0 +1,169 @@
+# Version 3.0, hosted x86-64 (System V ABI) port of asm.s
+#
+# running, nextP and host_irq_enabled are thread-local, one copy per core
+# (see KERNEL_CORES), and accessed with the local-exec model: the port is
+# only linked into executables.
+
+/**
+  * Two kinds of frames are saved on the stack of a suspended process, with
+  * a tag in their first word so that any path can resume either of them.
+  *
+  * Full frame (tag 1), saved by _transfer for switches from an ISR:
+  *   0: tag, 8..72: r11-r8, rdi, rsi, rdx, rcx, rax,
+  *   80..120: r15-r12, rbx, rbp, 128: status, 136: return address
+  *
+  * Partial frame (tag 0), saved by _transferVoluntary, callee-saved only:
+  *   0: tag, 8..48: r15-r12, rbx, rbp, 56: status, 64: return address
+  */
+
+/**
+  * Initialize the stack of a process in such a way that it can be read
+  * from the transfer function.
+  * The partial frame holds the callee-saved registers, the interrupt switch
+  * status (initialized to 1) and the return address, which is the entry point.
+  * Above it sits the return address of the entry point itself, so that a
+  * process function that returns traps instead of running off its stack.
+  * A pointer to the stack pointer is returned, it is the first word of the
+  * process context block, 16 byte aligned at the end of the stack.
+  */
+	.text
+	.globl _createStack
+	.type _createStack, @function
+_createStack:           # rdi = newSP
+                        # rsi = newPC
+                        # edx = stackSize - sizeof(struct ProcessContext)
+	movslq %edx, %rdx
+	# pointer to the bottom of the stack, 16 byte aligned, holding the sp
+	leaq  -8(%rdi,%rdx), %rax
+	andq  $-16, %rax
+	leaq  _processReturned(%rip), %rcx
+	movq  %rcx, -8(%rax)     # return address of the entry point
+	movq  %rsi, -16(%rax)    # PC
+	movq  $1, -24(%rax)      # status = 1
+	movq  $0, -32(%rax)      # rbp = 0 terminates back traces
+	leaq  -80(%rax), %rcx    # sp, rbx and r12-r15 are left uninitialized
+	movq  $0, (%rcx)         # tag = partial frame
+	# store sp on the stack bottom
+	movq  %rcx, (%rax)
+	# return pointer to stack address
+	ret
+	.size _createStack, .-_createStack
+
+_processReturned:
+	ud2
+
+/**
+ * Context switch called from an interrupt routine. Every register and the
+ * interrupt switch status are saved in a full frame.
+ * Interrupts stay disabled while running and nextP are inconsistent.
+ */
+	.globl _transfer
+	.type _transfer, @function
+_transfer:
+	pushq $0                 # room for the status
+	pushq %rbp
+	pushq %rbx
+	pushq %r12
+	pushq %r13
+	pushq %r14
+	pushq %r15
+	pushq %rax
+	pushq %rcx
+	pushq %rdx
+	pushq %rsi
+	pushq %rdi
+	pushq %r8
+	pushq %r9
+	pushq %r10
+	pushq %r11
+	movslq %fs:host_irq_enabled@tpoff, %rax
+	movl  $0, %fs:host_irq_enabled@tpoff
+	movq  %rax, 120(%rsp)
+	pushq $1                 # tag = full frame
+	jmp   _switch
+	.size _transfer, .-_transfer
+
+/**
+ * Context switch called from a normal context (yield, wait, attendre...).
+ * The caller-saved registers are dead at the call site, so only the
+ * callee-saved ones and the interrupt switch status are kept.
+ * A status of 1 is restored through restoreInterrupts, which replays the
+ * interrupts raised meanwhile and, with several cores, releases the kernel
+ * lock.
+ */
+	.globl _transferVoluntary
+	.type _transferVoluntary, @function
+_transferVoluntary:
+	movslq %fs:host_irq_enabled@tpoff, %rax
+	movl  $0, %fs:host_irq_enabled@tpoff
+	pushq %rax
+	pushq %rbp
+	pushq %rbx
+	pushq %r12
+	pushq %r13
+	pushq %r14
+	pushq %r15
+	pushq $0                 # tag = partial frame
+_switch:
+	# running->sp = sp
+	movq  %fs:running@tpoff, %rax
+	movq  %rsp, (%rax)
+	# running = nextP
+	movq  %fs:nextP@tpoff, %rax
+	movq  %rax, %fs:running@tpoff
+	# set sp to the sp from the nextP
+	movq  (%rax), %rsp
+	# resume according to the kind of frame nextP was suspended with
+	popq  %rax
+	testq %rax, %rax
+	jnz   _restoreFull
+	# restore interrupt switch status, it is still 0. The stack is not
+	# aligned in the first frame of a process.
+	movl  48(%rsp), %edi
+	testl %edi, %edi
+	jz    1f
+	movq  %rsp, %rbx         # rbx is restored below
+	andq  $-16, %rsp
+	call  restoreInterrupts
+	movq  %rbx, %rsp
+1:
+	popq  %r15
+	popq  %r14
+	popq  %r13
+	popq  %r12
+	popq  %rbx
+	popq  %rbp
+	addq  $8, %rsp           # status
+	ret
+
+_restoreFull:
+	# restore interrupt switch status, replaying the pending interrupts
+	# while the caller-saved registers are still on the stack
+	movl  120(%rsp), %edi
+	testl %edi, %edi
+	jz    2f
+	movq  %rsp, %rbx         # rbx is restored below
+	andq  $-16, %rsp
+	call  restoreInterrupts
+	movq  %rbx, %rsp
+2:
+	popq  %r11
+	popq  %r10
+	popq  %r9
+	popq  %r8
+	popq  %rdi
+	popq  %rsi
+	popq  %rdx
+	popq  %rcx
+	popq  %rax
+	popq  %r15
+	popq  %r14
+	popq  %r13
+	popq  %r12
+	popq  %rbx
+	popq  %rbp
+	addq  $8, %rsp           # status
+	ret
+	.size _transferVoluntary, .-_transferVoluntary
+
+	.section .note.GNU-stack,"",@progbits
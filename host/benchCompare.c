@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Compares two outputs of kernelBench, e.g. of two commits:
+ *
+ *   gcc -O2 host/benchCompare.c -o benchCompare
+ *   ./benchCompare before.log after.log
+ *
+ * Prints one line per benchmark found in both, with its figure before and
+ * after and the change in percent; cycles_per_op, switches_per_op and bytes
+ * are better when lower, ops_per_sec when higher. Other lines are ignored.
+ */
+
+#define MAX_RESULTS 1024
+#define NAME_SIZE 64
+
+typedef struct {
+    char name[NAME_SIZE]; // benchmark name and unit, e.g. yield_pingpong cycles_per_op
+    double value;
+} Result;
+
+typedef struct {
+    Result results[MAX_RESULTS];
+    int count;
+} Log;
+
+static Log before, after;
+
+static const char* units[] = { "cycles_per_op", "switches_per_op", "ops_per_sec", "bytes", "count" };
+
+static void readLog(const char* path, Log* log)
+{
+    FILE* in = fopen(path, "r");
+    char line[256], bench[48], key[NAME_SIZE];
+    unsigned int i;
+
+    if (in == NULL) {
+        perror(path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char* text = strstr(line, "bench ");
+
+        if (text == NULL || sscanf(text, "bench %47s", bench) != 1) {
+            continue;
+        }
+        for (i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+            char* field;
+
+            sprintf(key, " %s=", units[i]);
+            field = strstr(text, key);
+            if (field == NULL || log->count == MAX_RESULTS) {
+                continue;
+            }
+            snprintf(log->results[log->count].name, NAME_SIZE, "%s %s", bench, units[i]);
+            log->results[log->count].value = atof(field + strlen(key));
+            log->count++;
+        }
+    }
+    fclose(in);
+}
+
+static Result* find(Log* log, const char* name)
+{
+    int i;
+
+    for (i = 0; i < log->count; i++) {
+        if (strcmp(log->results[i].name, name) == 0) {
+            return &log->results[i];
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    int i;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s before.log after.log\n", argv[0]);
+        return 1;
+    }
+    readLog(argv[1], &before);
+    readLog(argv[2], &after);
+
+    for (i = 0; i < after.count; i++) {
+        Result* old = find(&before, after.results[i].name);
+        double change;
+
+        if (old == NULL) {
+            continue;
+        }
+        change = old->value != 0 ? (after.results[i].value - old->value) * 100 / old->value : 0;
+        printf("%-48s %14.2f %14.2f %+8.1f%%\n", after.results[i].name,
+                old->value, after.results[i].value, change);
+    }
+    return 0;
+}
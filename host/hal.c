@@ -0,0 +1,604 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <stdint.h>
+
+#include "system.h"
+#include "alt_types.h"
+#include "sys/alt_irq.h"
+#include "altera_avalon_pio_regs.h"
+#include "altera_avalon_timer_regs.h"
+#include "hal.h"
+#include "interrupt.h"
+#if KERNEL_CORES > 1
+#include <pthread.h>
+#endif
+
+/*
+ * Emulation of the qsys_top_new peripherals used by the kernel.
+ *
+ * Interrupts are delivered as signals on the stack of the running process,
+ * exactly like the Nios II exception handler runs on the interrupted stack.
+ * Handlers are installed with SA_NODEFER: an ISR that calls transfer()
+ * leaves its signal frame on the interrupted stack, and the process it
+ * switches to must still be able to take the next interrupt. As a
+ * consequence every process stack has to be large enough for a signal
+ * frame (a few KB with the extended FPU state).
+ *
+ * Built with KERNEL_CORES > 1, cores 1 and up are threads started by
+ * startCores with the interrupt signals blocked: only core 0 runs the
+ * interrupt routines. Each core has its own interrupt switch, and one
+ * spinlock, the kernel lock, is held by the core whose switch is off:
+ * disabling the interrupts is all the kernel does to exclude both the
+ * interrupt routines and the other cores. A process switched from an
+ * interrupt routine may resume on another core and return from the signal
+ * there, which restores the signal mask of core 0 on that thread. A signal
+ * that then lands on another core blocks the signals again and is passed on
+ * to core 0, and the interrupts left pending by another core are run by
+ * core 0 when it gets SIGURG.
+ */
+
+#define MAX_IRQ 32
+
+typedef struct {
+    alt_isr_func isr;
+    void* context;
+} IrqHandler;
+
+typedef struct {
+    unsigned int data;
+    unsigned int direction;
+    unsigned int irqMask;
+    unsigned int edgeCapture;
+} Pio;
+
+typedef struct {
+    unsigned int status;
+    unsigned int control;
+    unsigned int period;
+    unsigned int snapshot;
+    unsigned long long started; // tick at which the counter was last (re)loaded
+} Timer;
+
+__thread volatile int host_irq_enabled = 1;
+volatile unsigned int host_irq_pending = 0;
+
+// number of the core of the thread
+static __thread int core = 0;
+
+#if KERNEL_CORES > 1
+static volatile int kernelLock = 0;
+// thread of core 0, the one that takes the interrupts
+static pthread_t firstCore;
+// a SIGURG is on its way to core 0, the other cores need not send another
+static volatile int kickPending = 0;
+#endif
+
+static IrqHandler handlers[MAX_IRQ];
+
+static Pio buttons, led0, led1, led2, ledColor, switch0, switch1;
+// reset value of the period registers is the one set in Qsys: 1 ms for timer
+static Timer timer = { 0, 0, TIMER_FREQ / 1000 - 1, 0, 0 };
+static Timer timer1 = { 0, 0, 0xffffffff, 0, 0 };
+
+/**
+ * Current time expressed in ticks of the emulated timer clock.
+ **/
+static unsigned long long now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * TIMER_FREQ
+        + (unsigned long long) ts.tv_nsec * (TIMER_FREQ / 1000000) / 1000;
+}
+
+static Pio* pioAt(unsigned int base)
+{
+    switch(base)
+    {
+    case BUTTONS_BASE: return &buttons;
+    case LED_0_BASE: return &led0;
+    case LED_1_BASE: return &led1;
+    case LED_2_BASE: return &led2;
+    case LED_COLOR_BASE: return &ledColor;
+    case SWITCH_0_BASE: return &switch0;
+    case SWITCH_1_BASE: return &switch1;
+    }
+    return NULL;
+}
+
+static Timer* timerAt(unsigned int base)
+{
+    switch(base)
+    {
+    case TIMER_BASE: return &timer;
+    case TIMER_1_BASE: return &timer1;
+    }
+    return NULL;
+}
+
+/**
+ * Value the down counter of t has at this instant.
+ **/
+static unsigned int counterValue(Timer* t)
+{
+    unsigned long long elapsed;
+
+    if(!(t->status & ALTERA_AVALON_TIMER_STATUS_RUN_MSK))
+    {
+        return t->period;
+    }
+    elapsed = now() - t->started;
+    if(!(t->control & ALTERA_AVALON_TIMER_CONTROL_CONT_MSK) && elapsed > t->period)
+    {
+        return 0;
+    }
+    return t->period - (unsigned int) (elapsed % ((unsigned long long) t->period + 1));
+}
+
+static void installSignal(int sig);
+
+/**
+ * Programs SIGALRM for the interrupt timer. Only TIMER_BASE is wired to an
+ * interrupt line in the hosted build, timer_1 is used as a timestamp counter.
+ **/
+static void armTimer(Timer* t)
+{
+    struct itimerval it;
+    unsigned long long usec;
+
+    if(t != &timer)
+    {
+        return;
+    }
+    memset(&it, 0, sizeof(it));
+    if((t->status & ALTERA_AVALON_TIMER_STATUS_RUN_MSK) &&
+       (t->control & ALTERA_AVALON_TIMER_CONTROL_ITO_MSK))
+    {
+        usec = ((unsigned long long) t->period + 1) * 1000000 / TIMER_FREQ;
+        if(usec == 0)
+        {
+            usec = 1;
+        }
+        // init_clock starts the timer before registering its handler, the
+        // interrupt must stay pending instead of killing us meanwhile
+        installSignal(SIGALRM);
+        it.it_value.tv_sec = usec / 1000000;
+        it.it_value.tv_usec = usec % 1000000;
+        if(t->control & ALTERA_AVALON_TIMER_CONTROL_CONT_MSK)
+        {
+            it.it_interval = it.it_value;
+        }
+    }
+    setitimer(ITIMER_REAL, &it, NULL);
+}
+
+static void writeTimer(Timer* t, int reg, unsigned int data)
+{
+    switch(reg)
+    {
+    case ALTERA_AVALON_TIMER_STATUS_REG:
+        t->status &= ~ALTERA_AVALON_TIMER_STATUS_TO_MSK;
+        break;
+    case ALTERA_AVALON_TIMER_CONTROL_REG:
+        t->control = data & (ALTERA_AVALON_TIMER_CONTROL_ITO_MSK | ALTERA_AVALON_TIMER_CONTROL_CONT_MSK);
+        if(data & ALTERA_AVALON_TIMER_CONTROL_START_MSK)
+        {
+            t->status |= ALTERA_AVALON_TIMER_STATUS_RUN_MSK;
+            t->started = now();
+        }
+        if(data & ALTERA_AVALON_TIMER_CONTROL_STOP_MSK)
+        {
+            t->status &= ~ALTERA_AVALON_TIMER_STATUS_RUN_MSK;
+        }
+        armTimer(t);
+        break;
+    case ALTERA_AVALON_TIMER_PERIODL_REG:
+        // writing a period register stops the timer and reloads the counter
+        t->period = (t->period & 0xffff0000) | (data & 0xffff);
+        t->status &= ~ALTERA_AVALON_TIMER_STATUS_RUN_MSK;
+        armTimer(t);
+        break;
+    case ALTERA_AVALON_TIMER_PERIODH_REG:
+        t->period = (t->period & 0xffff) | (data << 16);
+        t->status &= ~ALTERA_AVALON_TIMER_STATUS_RUN_MSK;
+        armTimer(t);
+        break;
+    case ALTERA_AVALON_TIMER_SNAPL_REG:
+    case ALTERA_AVALON_TIMER_SNAPH_REG:
+        t->snapshot = counterValue(t);
+        break;
+    }
+}
+
+static unsigned int readTimer(Timer* t, int reg)
+{
+    switch(reg)
+    {
+    case ALTERA_AVALON_TIMER_STATUS_REG:
+        if(counterValue(t) == 0 && !(t->control & ALTERA_AVALON_TIMER_CONTROL_CONT_MSK))
+        {
+            t->status &= ~ALTERA_AVALON_TIMER_STATUS_RUN_MSK;
+        }
+        return t->status;
+    case ALTERA_AVALON_TIMER_CONTROL_REG:
+        return t->control;
+    case ALTERA_AVALON_TIMER_PERIODL_REG:
+        return t->period & 0xffff;
+    case ALTERA_AVALON_TIMER_PERIODH_REG:
+        return t->period >> 16;
+    case ALTERA_AVALON_TIMER_SNAPL_REG:
+        return t->snapshot & 0xffff;
+    case ALTERA_AVALON_TIMER_SNAPH_REG:
+        return t->snapshot >> 16;
+    }
+    return 0;
+}
+
+unsigned int host_iord(unsigned int base, int reg)
+{
+    Pio* pio = pioAt(base);
+    Timer* t = timerAt(base);
+
+    if(t != NULL)
+    {
+        return readTimer(t, reg);
+    }
+    if(pio != NULL)
+    {
+        switch(reg)
+        {
+        case ALTERA_AVALON_PIO_DATA: return pio->data;
+        case ALTERA_AVALON_PIO_DIRECTION: return pio->direction;
+        case ALTERA_AVALON_PIO_IRQ_MASK: return pio->irqMask;
+        case ALTERA_AVALON_PIO_EDGE_CAP: return pio->edgeCapture;
+        }
+    }
+    return 0;
+}
+
+void host_iowr(unsigned int base, int reg, unsigned int data)
+{
+    Pio* pio = pioAt(base);
+    Timer* t = timerAt(base);
+
+    if(t != NULL)
+    {
+        writeTimer(t, reg, data);
+        return;
+    }
+    if(pio != NULL)
+    {
+        switch(reg)
+        {
+        case ALTERA_AVALON_PIO_DATA: pio->data = data; break;
+        case ALTERA_AVALON_PIO_DIRECTION: pio->direction = data; break;
+        case ALTERA_AVALON_PIO_IRQ_MASK: pio->irqMask = data; break;
+        // edge capture bits are cleared by writing ones to them
+        case ALTERA_AVALON_PIO_EDGE_CAP: pio->edgeCapture &= ~data; break;
+        }
+    }
+}
+
+/**
+ * Interrupt lines are level triggered: a request that was acknowledged
+ * while it was pending (status or edge capture cleared) is dropped.
+ **/
+static int irqAsserted(int id)
+{
+    switch(id)
+    {
+    case TIMER_IRQ:
+        return (timer.status & ALTERA_AVALON_TIMER_STATUS_TO_MSK) &&
+               (timer.control & ALTERA_AVALON_TIMER_CONTROL_ITO_MSK);
+    case BUTTONS_IRQ:
+        return (buttons.edgeCapture & buttons.irqMask) != 0;
+    }
+    return 1;
+}
+
+/**
+ * Turns the interrupt switch of the core off and returns its previous
+ * status. With several cores, the kernel lock goes with the switch: it is
+ * taken when the switch goes off, interrupts arriving in the meantime stay
+ * pending. A signal handler does not spin, signals would pile up on the
+ * stack: if the lock is busy, the switch stays on and 0 is returned, the
+ * core holding the lock sends them to core 0 when it releases it.
+ * These run out of line: the thread pointer must be read again after a
+ * switch, the process may have moved to another core.
+ **/
+static __attribute__((noinline)) int irqOff(int spin)
+{
+    int status = __atomic_exchange_n(&host_irq_enabled, 0, __ATOMIC_SEQ_CST);
+#if KERNEL_CORES > 1
+    if(status)
+    {
+        while(__atomic_exchange_n(&kernelLock, 1, __ATOMIC_ACQUIRE))
+        {
+            if(!spin)
+            {
+                host_irq_enabled = 1;
+                return 0;
+            }
+            while(kernelLock)
+            {
+                __builtin_ia32_pause();
+            }
+        }
+    }
+#else
+    (void) spin;
+#endif
+    return status;
+}
+
+/* Turns the interrupt switch of the core on, without replaying. */
+static __attribute__((noinline)) void irqOn(void)
+{
+    if(!host_irq_enabled)
+    {
+#if KERNEL_CORES > 1
+        __atomic_store_n(&kernelLock, 0, __ATOMIC_RELEASE);
+#endif
+        host_irq_enabled = 1;
+    }
+}
+
+#if KERNEL_CORES > 1
+/* Out of line for the same reason as irqOff. */
+static __attribute__((noinline)) int onFirstCore(void)
+{
+    return core == 0;
+}
+#endif
+
+/**
+ * Interrupt controller: runs the ISR of every pending line, one at a time
+ * and with interrupts disabled, like the HAL exception handler does.
+ * An ISR may transfer() to another process; the loop then resumes when
+ * the interrupted process is transferred back to.
+ **/
+static void runPending(int spin)
+{
+    while(host_irq_pending != 0)
+    {
+#if KERNEL_CORES > 1
+        if(!onFirstCore())
+        {
+            if(!__atomic_exchange_n(&kickPending, 1, __ATOMIC_SEQ_CST))
+            {
+                pthread_kill(firstCore, SIGURG);
+            }
+            return;
+        }
+#endif
+        if(!irqOff(spin))
+        {
+            return;
+        }
+        int id = __builtin_ctz(host_irq_pending);
+        __atomic_fetch_and(&host_irq_pending, ~(1u << id), __ATOMIC_SEQ_CST);
+        if(handlers[id].isr != NULL && irqAsserted(id))
+        {
+            handlers[id].isr(handlers[id].context, id);
+        }
+        irqOn();
+    }
+}
+
+void host_irq_replay(void)
+{
+    runPending(1);
+}
+
+static void raiseIrq(int id)
+{
+    __atomic_fetch_or(&host_irq_pending, 1u << id, __ATOMIC_SEQ_CST);
+    runPending(0);
+}
+
+void host_press_buttons(unsigned int mask)
+{
+    buttons.edgeCapture |= mask;
+    if(buttons.edgeCapture & buttons.irqMask)
+    {
+        raiseIrq(BUTTONS_IRQ);
+    }
+}
+
+static void onSignal(int sig, siginfo_t* info, void* context)
+{
+    (void) info;
+#if KERNEL_CORES > 1
+    if(!onFirstCore())
+    {
+        // the signals stay blocked once the handler returns
+        ucontext_t* uc = context;
+        sigaddset(&uc->uc_sigmask, SIGALRM);
+        sigaddset(&uc->uc_sigmask, SIGUSR1);
+        sigaddset(&uc->uc_sigmask, SIGUSR2);
+        pthread_kill(firstCore, sig);
+        return;
+    }
+#else
+    (void) context;
+#endif
+    switch(sig)
+    {
+    case SIGALRM:
+        timer.status |= ALTERA_AVALON_TIMER_STATUS_TO_MSK;
+        if(!(timer.control & ALTERA_AVALON_TIMER_CONTROL_CONT_MSK))
+        {
+            timer.status &= ~ALTERA_AVALON_TIMER_STATUS_RUN_MSK;
+        }
+        raiseIrq(TIMER_IRQ);
+        break;
+    case SIGUSR1:
+        host_press_buttons(0x1);
+        break;
+    case SIGUSR2:
+        host_press_buttons(0x2);
+        break;
+#if KERNEL_CORES > 1
+    case SIGURG:
+        __atomic_store_n(&kickPending, 0, __ATOMIC_SEQ_CST);
+        runPending(0);
+        break;
+#endif
+    }
+}
+
+static void installSignal(int sig)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = onSignal;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(sig, &sa, NULL);
+}
+
+int alt_irq_register(alt_u32 id, void* context, alt_isr_func handler)
+{
+    if(id >= MAX_IRQ)
+    {
+        return -1;
+    }
+    handlers[id].isr = handler;
+    handlers[id].context = context;
+
+    if(id == TIMER_IRQ)
+    {
+        installSignal(SIGALRM);
+    }
+    else if(id == BUTTONS_IRQ)
+    {
+        installSignal(SIGUSR1);
+        installSignal(SIGUSR2);
+    }
+    return 0;
+}
+
+void maskInterrupts()
+{
+    irqOff(1);
+}
+
+void allowInterrupts()
+{
+    irqOn();
+    host_irq_replay();
+}
+
+int disableInterrupts()
+{
+    return irqOff(1);
+}
+
+void restoreInterrupts(int status)
+{
+    if(status)
+    {
+        irqOn();
+        host_irq_replay();
+    }
+    else
+    {
+        irqOff(1);
+    }
+}
+
+#if KERNEL_CORES > 1
+/**
+ * The other cores make processes ready at any time and no interrupt tells
+ * this one about it: spin a little with the kernel lock released instead
+ * of sleeping, the caller checks the run queues again.
+ **/
+void waitForInterrupt()
+{
+    int i;
+
+    irqOn();
+    host_irq_replay();
+    for(i = 0; i < 256; i++)
+    {
+        __builtin_ia32_pause();
+    }
+    irqOff(1);
+}
+#else
+/**
+ * Sleeps until a signal comes. The signals are blocked from the moment
+ * interrupts are allowed, so none can slip in before sigsuspend.
+ **/
+void waitForInterrupt()
+{
+    sigset_t irqs, previous;
+
+    sigemptyset(&irqs);
+    sigaddset(&irqs, SIGALRM);
+    sigaddset(&irqs, SIGUSR1);
+    sigaddset(&irqs, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &irqs, &previous);
+    host_irq_enabled = 1;
+    if(host_irq_pending != 0)
+    {
+        sigprocmask(SIG_SETMASK, &previous, NULL);
+        host_irq_replay();
+    }
+    else
+    {
+        sigsuspend(&previous);
+        sigprocmask(SIG_SETMASK, &previous, NULL);
+    }
+    host_irq_enabled = 0;
+}
+#endif
+
+int coreId()
+{
+    return core;
+}
+
+#if KERNEL_CORES > 1
+static void (*coreEntry)();
+
+static void* runCore(void* arg)
+{
+    core = (int) (intptr_t) arg;
+    coreEntry();
+    return NULL;
+}
+
+void startCores(int cores, void (*entry)())
+{
+    sigset_t irqs, previous;
+    pthread_t thread;
+    int i;
+
+    // the threads inherit the blocked signals
+    sigemptyset(&irqs);
+    sigaddset(&irqs, SIGALRM);
+    sigaddset(&irqs, SIGUSR1);
+    sigaddset(&irqs, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &irqs, &previous);
+    firstCore = pthread_self();
+    installSignal(SIGURG);
+    coreEntry = entry;
+    for(i = 1; i < cores; i++)
+    {
+        if(pthread_create(&thread, NULL, runCore, (void*) (intptr_t) i) != 0)
+        {
+            fprintf(stderr, "Error: cannot start core %d\n", i);
+            exit(1);
+        }
+        pthread_detach(thread);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+#endif
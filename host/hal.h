@@ -0,0 +1,29 @@
+#ifndef HAL_H_
+#define HAL_H_
+
+/*
+ * Emulated peripherals and interrupt controller of the hosted build.
+ * Register accesses of the Altera macros end up in host_iord/host_iowr,
+ * interrupt lines are raised by POSIX signals (SIGALRM for the timer,
+ * SIGUSR1/SIGUSR2 for buttons 0 and 1) or by host_press_buttons.
+ */
+
+/* Reads register reg of the emulated device at address base. */
+unsigned int host_iord(unsigned int base, int reg);
+
+/* Writes register reg of the emulated device at address base. */
+void host_iowr(unsigned int base, int reg, unsigned int data);
+
+/* Latches mask into the button edge capture register and raises its interrupt. */
+void host_press_buttons(unsigned int mask);
+
+/* Software copy of the Nios II status.PIE bit of each core, saved and restored by _transfer. */
+extern __thread volatile int host_irq_enabled;
+
+/* One bit per interrupt line that was raised while interrupts were masked. */
+extern volatile unsigned int host_irq_pending;
+
+/* Runs the handlers of all pending interrupt lines if interrupts are enabled. */
+void host_irq_replay(void);
+
+#endif /*HAL_H_*/
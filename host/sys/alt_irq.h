@@ -0,0 +1,12 @@
+#ifndef ALT_IRQ_H_
+#define ALT_IRQ_H_
+
+/* Hosted stand-in for the HAL legacy interrupt API, see host/hal.c */
+
+#include "alt_types.h"
+
+typedef void (*alt_isr_func)(void* isr_context, alt_u32 id);
+
+int alt_irq_register(alt_u32 id, void* context, alt_isr_func handler);
+
+#endif /*ALT_IRQ_H_*/
@@ -0,0 +1,41 @@
+#ifndef SYSTEM_H_
+#define SYSTEM_H_
+
+/*
+ * Hosted stand-in for the system.h generated by the Nios II BSP.
+ * Base addresses and IRQ numbers are the ones of qsys_top_new.sopcinfo,
+ * the peripherals behind them are emulated by host/hal.c.
+ */
+
+#define ALT_CPU_FREQ 50000000
+
+#define ONCHIP_MEM_BASE 0x2000000
+#define ONCHIP_MEM_SPAN 16384
+#define SDRAM_BASE 0x0
+#define SDRAM_SPAN 33554432
+
+#define BUTTONS_BASE 0x2005000
+#define BUTTONS_IRQ 2
+
+#define LED_0_BASE 0x2005020
+#define LED_1_BASE 0x2005060
+#define LED_2_BASE 0x2005040
+#define LED_COLOR_BASE 0x20050f0
+#define LED_COLOR_RESET_VALUE 0x0
+
+#define SWITCH_0_BASE 0x2005080
+#define SWITCH_1_BASE 0x20050e0
+
+#define TIMER_BASE 0x20050a0
+#define TIMER_IRQ 0
+#define TIMER_FREQ 50000000
+
+#define TIMER_1_BASE 0x20050c0
+#define TIMER_1_IRQ 1
+#define TIMER_1_FREQ 50000000
+
+// The kernel's own processes take the interrupts, that is the signal frames
+// and their extended FPU state, possibly nested: give them room.
+#define IDLE_STACK_SIZE 32768
+
+#endif /*SYSTEM_H_*/
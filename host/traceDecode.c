@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "trace.h"
+
+/*
+ * Turns a kernel trace into Chrome trace JSON (chrome://tracing, Perfetto).
+ * The input is either a memory dump of traceBuffer, e.g. from nios2-elf-gdb
+ *
+ *   dump binary value trace.bin traceBuffer
+ *
+ * or the output of traceDump() captured from the JTAG UART, other lines
+ * being ignored:
+ *
+ *   gcc -O2 -I. -Ihost host/traceDecode.c -o traceDecode
+ *   ./traceDecode trace.bin > trace.json
+ *
+ * Each process is a thread running between its switches, interrupt
+ * routines are on a thread of their own, the other records are instants.
+ */
+
+#define ISR_THREAD -1
+
+static const char* names[TRACE_TYPES] = {
+    "switch", "enqueue", "dequeue", "splice", "monitor enter", "monitor block",
+    "monitor wait", "monitor exit", "event fire", "isr enter", "isr exit"
+};
+
+static TraceBuffer buffer;
+static unsigned int count; // records read, the oldest first
+static unsigned long long frequency;
+
+// 64 bit cycle count of the records, the timestamps wrap around every 2^32 cycles
+static unsigned long long cycles;
+static unsigned int lastTime;
+
+static int first = 1;
+
+static void emit(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void emit(const char* fmt, ...)
+{
+    va_list args;
+
+    printf(first ? "\n" : ",\n");
+    first = 0;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+static double micros(void)
+{
+    return (double) cycles * 1e6 / frequency;
+}
+
+static void threadName(int tid, const char* name)
+{
+    emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            tid, name);
+}
+
+// processes we have seen, to name their threads once
+#define MAX_NAMED 4096
+static int named[MAX_NAMED];
+static int namedCount;
+
+static void seen(int process)
+{
+    char name[32];
+    int i;
+
+    for (i = 0; i < namedCount; i++) {
+        if (named[i] == process) {
+            return;
+        }
+    }
+    if (namedCount < MAX_NAMED) {
+        named[namedCount++] = process;
+    }
+    sprintf(name, "process %d", process);
+    threadName(process, name);
+}
+
+static void decode(void)
+{
+    int running = -1, runningOpen = 0, isrOpen = 0;
+    unsigned int i;
+
+    if (count == 0) {
+        return;
+    }
+    lastTime = buffer.records[0].time;
+    threadName(ISR_THREAD, "interrupts");
+    for (i = 0; i < count; i++) {
+        TraceRecord* r = &buffer.records[i];
+        const char* name = r->type < TRACE_TYPES ? names[r->type] : "unknown";
+
+        cycles += r->time - lastTime;
+        lastTime = r->time;
+        seen(r->process);
+        switch (r->type) {
+        case TRACE_SWITCH:
+            if (isrOpen) {
+                // _transfer leaves the interrupt routine
+                emit("{\"name\":\"isr\",\"ph\":\"E\",\"pid\":0,\"tid\":%d,\"ts\":%.3f}", ISR_THREAD, micros());
+                isrOpen = 0;
+            }
+            if (runningOpen) {
+                emit("{\"name\":\"run\",\"ph\":\"E\",\"pid\":0,\"tid\":%d,\"ts\":%.3f}", running, micros());
+            }
+            running = (int) r->arg;
+            seen(running);
+            emit("{\"name\":\"run\",\"ph\":\"B\",\"pid\":0,\"tid\":%d,\"ts\":%.3f}", running, micros());
+            runningOpen = 1;
+            break;
+        case TRACE_ISR_ENTER:
+            emit("{\"name\":\"isr\",\"ph\":\"B\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"args\":{\"irq\":%u}}",
+                    ISR_THREAD, micros(), r->arg);
+            isrOpen = 1;
+            break;
+        case TRACE_ISR_EXIT:
+            // exits of routines that switched have nothing to close
+            if (isrOpen) {
+                emit("{\"name\":\"isr\",\"ph\":\"E\",\"pid\":0,\"tid\":%d,\"ts\":%.3f}", ISR_THREAD, micros());
+                isrOpen = 0;
+            }
+            break;
+        case TRACE_ENQUEUE:
+        case TRACE_DEQUEUE:
+        case TRACE_SPLICE:
+            emit("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"args\":{\"list\":\"0x%08x\"}}",
+                    name, r->process, micros(), r->arg);
+            break;
+        case TRACE_EVENT_FIRE:
+            emit("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"args\":{\"event\":%u}}",
+                    name, r->process, micros(), r->arg);
+            break;
+        default:
+            emit("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"args\":{\"monitor\":%u}}",
+                    name, r->process, micros(), r->arg);
+            break;
+        }
+    }
+    if (runningOpen) {
+        emit("{\"name\":\"run\",\"ph\":\"E\",\"pid\":0,\"tid\":%d,\"ts\":%.3f}", running, micros());
+    }
+}
+
+// copies the valid records of a memory dump to buffer, the oldest first
+static void readDump(const char* data, size_t length)
+{
+    TraceBuffer* dump = (TraceBuffer*) data;
+    size_t header = offsetof(TraceBuffer, records);
+    unsigned int i, start = 0;
+
+    if (length < header || length < header + dump->size * sizeof(TraceRecord)) {
+        fprintf(stderr, "Error: truncated trace dump\n");
+        exit(1);
+    }
+    if (dump->size > TRACE_SIZE || (dump->size & (dump->size - 1)) != 0) {
+        fprintf(stderr, "Error: trace of %u records, rebuild with -DTRACE_SIZE=%u\n", dump->size, dump->size);
+        exit(1);
+    }
+    buffer.frequency = dump->frequency;
+    count = dump->next;
+    if (count > dump->size) {
+        start = dump->next - dump->size;
+        count = dump->size;
+    }
+    for (i = 0; i < count; i++) {
+        buffer.records[i] = dump->records[(start + i) & (dump->size - 1)];
+    }
+}
+
+static void readText(char* data)
+{
+    char* line;
+    unsigned int time, type, process, arg;
+    int begun = 0;
+
+    for (line = strtok(data, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        char* text = strstr(line, "trace ");
+
+        if (text == NULL) {
+            continue;
+        }
+        if (sscanf(text, "trace begin %x %x %x %x", &time, &type, &process, &arg) == 4) {
+            buffer.frequency = process;
+            count = 0;
+            begun = 1;
+        }
+        else if (strncmp(text, "trace end", 9) == 0) {
+            if (begun) {
+                return;
+            }
+        }
+        else if (begun && count < TRACE_SIZE
+                && sscanf(text, "trace %x %x %x %x", &time, &type, &process, &arg) == 4) {
+            buffer.records[count].time = time;
+            buffer.records[count].type = type;
+            buffer.records[count].process = (int) process;
+            buffer.records[count].arg = arg;
+            count++;
+        }
+    }
+    if (!begun) {
+        fprintf(stderr, "Error: no trace found\n");
+        exit(1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    FILE* in = stdin;
+    char* data = NULL;
+    size_t length = 0, room = 0;
+    unsigned int magic = 0;
+
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [trace dump or UART log]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 2 && (in = fopen(argv[1], "rb")) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    // the whole input, NUL terminated for the text reader
+    do {
+        if (length + 1 >= room) {
+            room = room ? 2 * room : 65536;
+            data = realloc(data, room);
+            if (data == NULL) {
+                fprintf(stderr, "Error: out of memory\n");
+                return 1;
+            }
+        }
+        length += fread(data + length, 1, room - length - 1, in);
+    } while (!feof(in) && !ferror(in));
+    data[length] = '\0';
+
+    if (length >= sizeof(magic)) {
+        memcpy(&magic, data, sizeof(magic));
+    }
+    if (magic == TRACE_MAGIC) {
+        readDump(data, length);
+    }
+    else {
+        readText(data);
+    }
+    frequency = buffer.frequency ? buffer.frequency : 50000000;
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    decode();
+    printf("\n]}\n");
+    return 0;
+}
@@ -9,74 +9,98 @@
 #include "interrupt.h"
 #include "assembly.h"
 #include "system_m.h"
+#include "kernel.h"
+#include "trace.h"
+#include "onchip.h"
 
 
 
-typedef struct ListElem{
+/* Processes waiting on an interrupt vector, chained through their ioNext field. */
+typedef struct {
 
-    Process p;
-    struct ListElem* next;
-    
-} ListElem;
+    Process head;
+    Process tail;
+
+} IoQueue;
 
-ListElem* interruptVector[2]={NULL,NULL};
+/* Vector 0 is the timer, vector 1 the buttons, the others are registered at run time, up to MAX_VECTORS
+   so that each of them also has a ring of deferred work. */
+IoQueue interruptVector[MAX_VECTORS];
+int vectorCount = 2;
 
+int registerInterruptVector(){
+
+    int status = disableInterrupts();
+    if(vectorCount == MAX_VECTORS){
+        restoreInterrupts(status);
+        printf("Error: There are already %d interrupt vectors\n", MAX_VECTORS);
+        return -1;
+    }
+    int vector = vectorCount++;
+    restoreInterrupts(status);
+    return vector;
+}
 
 Process removeHeadI(int i){
     
-    ListElem* removed = interruptVector[i];
-    if(interruptVector[i] != NULL){
-        interruptVector[i] = interruptVector[i] -> next;
-    }
+    Process removed = interruptVector[i].head;
     if(removed != NULL){
-        Process result = removed -> p; 
-		free(removed); 
-		return result;
+        interruptVector[i].head = removed -> ioNext;
+        if(interruptVector[i].head == NULL){
+            interruptVector[i].tail = NULL;
+        }
+        removed -> ioNext = NULL;
     }
-    else{
-        Process result = NULL;
-        return result;
-    }  
+    return removed;
 }
 
 void insertTail(int i, Process toBeInserted){
     
-    ListElem* elem = malloc(sizeof(ListElem));
-    elem -> p = toBeInserted;
-    elem -> next = NULL;
-    
-    ListElem* temp= NULL;
-    if(interruptVector[i] == NULL){
+    if(i < 0 || i >= vectorCount){
+        printf("Error: invalid interrupt vector %d\n", i);
+        exit(1);
+    }
+    toBeInserted -> ioNext = NULL;
+    if(interruptVector[i].head == NULL){
         
-       interruptVector[i] = elem; 
+       interruptVector[i].head = toBeInserted; 
     }
     else{
         
-        temp = interruptVector[i];
-        while((temp -> next) != NULL){
-        
-            temp = temp -> next;
-        }
-        temp -> next = elem;  
-    
+        interruptVector[i].tail -> ioNext = toBeInserted;
     }
-    
-        
+    interruptVector[i].tail = toBeInserted;
 }
 
 /* A variable to hold the value of the button pio edge capture register. */
 volatile int edge_capture = 0;
 
+/* Bottom half of the routines: the record goes to the deferred work of the kernel (see waitInterrupt),
+   or, if no process has ever waited for the vector there, the processor to the first process of iotransfer.
+   A record lost to a full ring is only counted. */
+ONCHIP_CODE static void deferInterrupt(int vector, unsigned int bits)
+{
+    if(postInterrupt(vector, bits) == INTERRUPT_UNARMED){
+        Process p2 = removeHeadI(vector);
+        if(p2 != NULL){
+            transfer(p2);
+        }
+    }
+}
+
 
-void handle_button_interrupts(void* context, alt_u32 id)
+ONCHIP_CODE void handle_button_interrupts(void* context, alt_u32 id)
 {
     
     /* Cast context to edge_capture's type. It is important that this be 
      * declared volatile to avoid unwanted compiler optimization.
      */
     volatile int* edge_capture_ptr = (volatile int*) context;
+
+    TRACE(TRACE_ISR_ENTER, traceProcess(), id);
     
-    /* Store the value in the Button's edge capture register in *context. */
+    /* Store the value in the Button's edge capture register in *context, the last edges only: every
+     * press has its record for waitInterrupt. */
     *edge_capture_ptr = IORD_ALTERA_AVALON_PIO_EDGE_CAP(BUTTONS_BASE);
 	/* Reset the edge capture register. */
     IOWR_ALTERA_AVALON_PIO_EDGE_CAP(BUTTONS_BASE, 0xf);
@@ -84,14 +108,9 @@ void handle_button_interrupts(void* context, alt_u32 id)
     /* Read the PIO to delay ISR exit. This is done to prevent a spurious interrupt in systems
      * with high processor -> pio latency and fast interrupts.  */
     IORD_ALTERA_AVALON_PIO_EDGE_CAP(BUTTONS_BASE);
-    
-    Process p2 = removeHeadI(1);
-   
-    if(p2 != NULL){
-        
-        transfer(p2);
-       
-    }
+
+    TRACE(TRACE_ISR_EXIT, traceProcess(), id);
+    deferInterrupt(1, *edge_capture_ptr);
 }
 
 /* Initialize the button_pio. */
@@ -115,21 +134,63 @@ void init_button()
 /* A variable to set up context for timer interrupt. */
 volatile int timer_capture = 0;
 
-void handle_timer_interrupts(void* context, alt_u32 id)
+ONCHIP_CODE void handle_timer_interrupts(void* context, alt_u32 id)
 {
+	TRACE(TRACE_ISR_ENTER, traceProcess(), id);
+
 	/* clear the interrupt */
 	IOWR_ALTERA_AVALON_TIMER_STATUS (TIMER_BASE, 0);
 
-	Process p2 = removeHeadI(0);
-    if(p2 != NULL){
-        transfer(p2);
-    }
+	/* vector 0 first, so that a switch is the last thing the routine does */
+	Process p2 = NULL;
+	if(postInterruptLater(0, 0) == INTERRUPT_UNARMED){
+		p2 = removeHeadI(0);
+	}
+	if(p2 != NULL){
+		/* the timers still expire, the processor goes to the process of iotransfer */
+		expireTick();
+		TRACE(TRACE_ISR_EXIT, traceProcess(), id);
+		transfer(p2);
+		return;
+	}
+
+	/* timers and time slicing of the kernel processes */
+	timerTick();
+
+	/* a switch to another process has already been traced as the end of the routine */
+	TRACE(TRACE_ISR_EXIT, traceProcess(), id);
+}
+
+/* Clock cycles per tick, from the period set in Qsys. 0 until init_clock. */
+unsigned int tickCycles = 0;
+
+/* Length of the current one-shot period and of its first, partial, tick. */
+unsigned int oneShotCycles, firstTickCycles, oneShotTicks;
+
+/* Latches the down counter of a timer and returns it. */
+unsigned int read_counter(unsigned int base)
+{
+  unsigned int snap;
+
+  /* any write to the snapshot register latches the counter */
+  IOWR_ALTERA_AVALON_TIMER_SNAPL (base, 0);
+  snap = IORD_ALTERA_AVALON_TIMER_SNAPL (base) & 0xffff;
+  snap |= (IORD_ALTERA_AVALON_TIMER_SNAPH (base) & 0xffff) << 16;
+  return snap;
+}
+
+void write_period(unsigned int base, unsigned int period)
+{
+  IOWR_ALTERA_AVALON_TIMER_PERIODL (base, period & 0xffff);
+  IOWR_ALTERA_AVALON_TIMER_PERIODH (base, period >> 16);
 }
 
 void init_clock()
 {
     
   void* timer_capture_ptr = (void*) &timer_capture;  
+  tickCycles = ((IORD_ALTERA_AVALON_TIMER_PERIODL (TIMER_BASE) & 0xffff) |
+                ((IORD_ALTERA_AVALON_TIMER_PERIODH (TIMER_BASE) & 0xffff) << 16)) + 1;
   /* set to free running mode */
   IOWR_ALTERA_AVALON_TIMER_CONTROL (TIMER_BASE, 
             ALTERA_AVALON_TIMER_CONTROL_ITO_MSK  |
@@ -141,6 +202,74 @@ void init_clock()
   
 }
 
+void init_timestamp()
+{
+  /* count down from the largest period, without interrupts */
+  IOWR_ALTERA_AVALON_TIMER_PERIODL (TIMER_1_BASE, 0xffff);
+  IOWR_ALTERA_AVALON_TIMER_PERIODH (TIMER_1_BASE, 0xffff);
+  IOWR_ALTERA_AVALON_TIMER_CONTROL (TIMER_1_BASE,
+            ALTERA_AVALON_TIMER_CONTROL_CONT_MSK |
+            ALTERA_AVALON_TIMER_CONTROL_START_MSK);
+}
+
+unsigned int read_timestamp()
+{
+  return 0xffffffff - read_counter(TIMER_1_BASE);
+}
+
+unsigned int clock_since_tick()
+{
+  return tickCycles - 1 - read_counter(TIMER_BASE);
+}
+
+int clock_one_shot(unsigned int ticks)
+{
+  unsigned int maxTicks;
+
+  if(tickCycles == 0 || ticks == 0){
+      return 0;
+  }
+  maxTicks = 0xffffffff / tickCycles - 1;
+  if(ticks > maxTicks){
+      ticks = maxTicks;
+  }
+
+  /* the first tick is the rest of the current period, so that the ticks stay in phase */
+  firstTickCycles = read_counter(TIMER_BASE) + 1;
+  oneShotTicks = ticks;
+  oneShotCycles = firstTickCycles + (ticks - 1) * tickCycles;
+
+  /* writing the period stops the timer, start it without the continuous mode */
+  write_period(TIMER_BASE, oneShotCycles - 1);
+  IOWR_ALTERA_AVALON_TIMER_CONTROL (TIMER_BASE,
+            ALTERA_AVALON_TIMER_CONTROL_ITO_MSK |
+            ALTERA_AVALON_TIMER_CONTROL_START_MSK);
+  return 1;
+}
+
+unsigned int clock_periodic()
+{
+  unsigned int ticks = oneShotTicks;
+  unsigned int elapsed;
+
+  if(IORD_ALTERA_AVALON_TIMER_STATUS (TIMER_BASE) & ALTERA_AVALON_TIMER_STATUS_RUN_MSK){
+      /* woken up by another interrupt, the phase of the tick is lost */
+      elapsed = oneShotCycles - (read_counter(TIMER_BASE) + 1);
+      ticks = elapsed < firstTickCycles ? 0 : 1 + (elapsed - firstTickCycles) / tickCycles;
+  }
+  else{
+      /* expired, the tick is counted here instead of by its interrupt */
+      IOWR_ALTERA_AVALON_TIMER_STATUS (TIMER_BASE, 0);
+  }
+
+  write_period(TIMER_BASE, tickCycles - 1);
+  IOWR_ALTERA_AVALON_TIMER_CONTROL (TIMER_BASE,
+            ALTERA_AVALON_TIMER_CONTROL_ITO_MSK  |
+            ALTERA_AVALON_TIMER_CONTROL_CONT_MSK |
+            ALTERA_AVALON_TIMER_CONTROL_START_MSK);
+  return ticks;
+}
+
 
 
 
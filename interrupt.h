@@ -1,17 +1,52 @@
 #ifndef INTERRUPT_H_
 #define INTERRUPT_H_
 
+#include <alt_types.h>
 #include "system_m.h"
 
+/* Number of interrupt vectors, for iotransfer as well as for the deferred work of waitInterrupt. */
+#ifndef MAX_VECTORS
+#define MAX_VECTORS 8
+#endif
+
 /* Function that enables all 4 button interrupts and that resets the edge capture register. */
 void init_button();
 
 /* Function that enables clock interrupts. */
 void init_clock();
 
+/* Interrupt routine of the timer, registered by init_clock. */
+void handle_timer_interrupts(void* context, alt_u32 id);
+
+/* Function that returns the number of timer clock cycles since the last tick was raised, in periodic mode. */
+unsigned int clock_since_tick();
+
+/* Function that replaces the periodic tick by a single interrupt after ticks ticks (clamped to what the
+   period registers hold). Returns 0 if the clock is not initialized. */
+int clock_one_shot(unsigned int ticks);
+
+/* Function that restores the periodic tick after clock_one_shot and returns the number of ticks elapsed. */
+unsigned int clock_periodic();
+
+/* Function that allows interrupts, waits for one to be handled and masks them again. */
+void waitForInterrupt();
+
+/* Function that starts timer_1 as a free running timestamp counter. */
+void init_timestamp();
+
+/* Function that returns the number of timer_1 clock cycles elapsed since init_timestamp. */
+unsigned int read_timestamp();
+
 /* Function used in implementation of iotransfer. */ 
 void insertTail(int i, Process toBeInserted);
 
+/* Function that returns the first process waiting on interrupt vector i, or NULL. Used in ISRs. */
+Process removeHeadI(int i);
+
+/* Function that adds an interrupt vector after the timer (0) and buttons (1) ones and returns its number,
+   or -1 once the MAX_VECTORS vectors are taken. */
+int registerInterruptVector();
+
 extern volatile int edge_capture;
 
 /* Function that masks all interrupts. */
@@ -20,4 +55,16 @@ void maskInterrupts();
 /* Function that allows all interrupts. */
 void allowInterrupts();
 
+/* Function that masks all interrupts and returns the previous interrupt switch status. */
+int disableInterrupts();
+
+/* Function that restores an interrupt switch status returned by disableInterrupts. */
+void restoreInterrupts(int status);
+
+/* Function that returns the number of the core running the caller, from 0 to KERNEL_CORES - 1 (hosted build). */
+int coreId();
+
+/* Function that starts cores 1 to cores - 1 on entry, the caller being core 0 (hosted build). */
+void startCores(int cores, void (*entry)());
+
 #endif /*INTERRUPT_H_*/
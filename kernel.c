@@ -2,44 +2,341 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <system.h>
 #include "kernel.h"
 #include "system_m.h"
 #include "interrupt.h"
-
-// Maximum number of processes.
-#define MAXPROCESS 10
+#include "trace.h"
+#include "stats.h"
+#include "task.h"
+#include "onchip.h"
+#ifdef KERNEL_STATIC
+#include "kernelConfig.h"
+#endif
+
+// Process descriptors are allocated by slabs of SLAB_SIZE
+#define SLAB_SHIFT 4
+#define SLAB_SIZE (1 << SLAB_SHIFT)
+// A process id is its descriptor index plus a generation number in the upper bits
+#define INDEX_BITS 16
+#define MAX_PROCESSES (1 << INDEX_BITS)
+#define GENERATION_MASK 0x7fff
+// Stacks are pooled by power of two size classes from 2^MIN_STACK_SHIFT to 2^MAX_STACK_SHIFT bytes
+#define MIN_STACK_SHIFT 10
+#define MAX_STACK_SHIFT 17
+#define STACK_CLASSES (MAX_STACK_SHIFT - MIN_STACK_SHIFT + 1)
+// Class of the stacks of the static configuration, never released
+#define STATIC_STACK_CLASS (STACK_CLASSES + 1)
+// Lowest word of every stack, a process that overwrote it overflowed its stack
+#define STACK_CANARY 0x5a17c0deu
+// With KERNEL_STACK_CHECK, the rest of a new stack is filled with it
+#define STACK_PAINT 0xa5a5a5a5u
 // Maximum number of monitors
+#ifndef MAX_MONITORS
 #define MAX_MONITORS 10
+#endif
 // Maximum number of events
+#ifndef MAX_EVENTS
 #define MAX_EVENTS 10
+#endif
+// Maximum number of channels
+#ifndef MAX_CHANNELS
+#define MAX_CHANNELS 10
+#endif
+// Maximum number of semaphores
+#ifndef MAX_SEMAPHORES
+#define MAX_SEMAPHORES 10
+#endif
+// Maximum number of reader-writer locks
+#ifndef MAX_RWLOCKS
+#define MAX_RWLOCKS 10
+#endif
+// Records a vector can have waiting for the deferred work, a power of two
+#ifndef INTERRUPT_RING_SIZE
+#define INTERRUPT_RING_SIZE 16
+#endif
+// Maximum number of periodic processes
+#ifndef MAX_PERIODIC
+#define MAX_PERIODIC 16
+#endif
+// Utilizations are in millionths of the processor
+#define UTILIZATION_SCALE 1000000
+// Share of the processor the periodic processes may reserve, all of it by default
+#ifndef MAX_UTILIZATION
+#define MAX_UTILIZATION UTILIZATION_SCALE
+#endif
+// Effective priority of the periodic processes, better than all the others: they are ordered by deadline
+#define REALTIME_PRIORITY -1
+// Timer wheel of WHEEL_LEVELS levels of WHEEL_SIZE slots, a slot of level i spans WHEEL_SIZE^i ticks
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+// The lock word of a monitor is 0 when it is free, else its owner id + 1, with CONTENDED set once
+// processes queue on it: only then does exitMonitor take the slow path
+#define CONTENDED 0x80000000u
+#define LOCK_OWNER(lock) ((int) ((lock) & ~CONTENDED) - 1)
+// Stack of the idle process
+#ifndef IDLE_STACK_SIZE
+#define IDLE_STACK_SIZE 8192
+#endif
+// Statistics calls, compiled out without KERNEL_STATS
+#ifdef KERNEL_STATS
+#define STATS(call) call
+#else
+#define STATS(call)
+#endif
+
+// FIFO of process ids chained through ProcessDescriptor.next
+typedef struct {
+    int head;
+    int tail;
+} Queue;
+
+#define EMPTY_QUEUE { -1, -1 }
+
+// FIFO of tasks chained through Task.next
+typedef struct {
+    Task* head;
+    Task* tail;
+} TaskQueue;
 
 typedef struct {
     int next;
     Process p;
+    void (*entry)(); // function run by the process
+    unsigned int* stack; // memory block of the stack, the canary is its first word
+    int stackSize; // bytes in the block
+    int stackClass; // size class of the stack, STACK_CLASSES if not pooled, STATIC_STACK_CLASS if static
+    int core; // core whose run queue the process goes to when it is ready, the last one it ran on
+    int generation; // incremented each time the descriptor is reused
+    bool alive; // false once the process has exited
+    Queue joiners; // processes waiting in joinProcess for this one to exit
+    int basePriority; // priority given at creation, 0 is the highest priority
+    int priority; // effective priority, raised by priority inheritance
+    bool ready; // true if the process is in readyList
+    int blockedOn; // monitor the process waits to enter, -1 if none
+    int quantum; // length of a time slice in timer ticks, 0 disables time slicing
+    int sliceLeft; // ticks left in the current time slice
+    bool maskSliceInMonitors; // true if the slice may not expire while in a monitor
+    bool slicePending; // the slice expired inside a monitor
     int monitors[MAX_MONITORS]; // monitors stack
     int m_sp; // stack pointer of the monitors stack
+    int timerSlot; // slot of the timer wheel the process is in, -1 if its timer is not armed
+    int timerNext; // links of the timer wheel slot
+    int timerPrev;
+    unsigned int timerExpiry; // tick at which the timer expires
+    bool timedOut; // the last timed wait ended because the timer expired
+    Queue* waitingOn; // queue the process leaves when its timer expires, NULL for sleepTicks
+    int waitMonitor; // monitor of a waitTimeout, -1 otherwise
+    InterruptRecord* interruptRecord; // where the deferred work copies the record waitInterrupt waits for
+    unsigned int period; // ticks between the releases of a periodic process, 0 for the others
+    unsigned int wcet; // ticks a job of a periodic process takes at worst
+    unsigned int release; // tick at which the current job was released
+    unsigned int deadline; // tick by which the current job must be done, its key in the deadline heap
+    unsigned int misses; // jobs that were done late or skipped
+    int heapIndex; // position in the deadline heap when the periodic process is ready
+#ifdef KERNEL_STATS
+    ProcessStats stats;
+    int state; // STATE_RUNNING, STATE_READY or STATE_BLOCKED
+    unsigned int stateSince; // timestamp of the last change of state
+    bool woken; // made ready after being blocked, its latency is measured when it runs
+#endif
 } ProcessDescriptor;
 
 typedef struct {
-    int waitingList; // contains all process that have called wait() and are not yet notified
-    int readyList; // contains all process that are waiting for the Monitor to be unlocked (they are ready to run)
-    bool locked;
+    Queue waitingList; // contains all process that have called wait() and are not yet notified
+    Queue readyList; // contains all process that are waiting for the Monitor to be unlocked (they are ready to run)
+    unsigned int lock; // lock word, see LOCK_OWNER
+    int depth; // number of times the owner entered the monitor
+    TaskQueue taskEntering; // tasks that found the monitor locked, woken up when it is free
+    TaskQueue taskWaiting; // tasks in TASK_WAIT
+#ifdef KERNEL_STATS
+    MonitorStats stats;
+    unsigned int acquiredAt; // timestamp of the outermost entry of the owner
+#endif
 } MonitorDescriptor;
 
 typedef struct {
-    int waitingList; // contains all process that are waiting on the event to happen
+    Queue waitingList; // contains all process that are waiting on the event to happen
     bool happened;
+    int mode; // EVENT_MANUAL_RESET, EVENT_AUTO_RESET or EVENT_PULSE
+    TaskQueue taskWaiting; // tasks waiting on the event, woken up after the processes
+#ifdef KERNEL_STATS
+    EventStats stats;
+#endif
 } EventDescriptor;
 
+typedef struct {
+    Queue waitingList; // processes waiting for the count to be positive
+    int count;
+} SemaphoreDescriptor;
+
+typedef struct {
+    Queue readersWaiting; // processes waiting in readLock
+    Queue writersWaiting; // processes waiting in writeLock
+    int readers; // number of processes holding the lock for reading
+    int writer; // process holding the lock for writing, -1 if none
+    bool writerPreference; // waiting writers go before new readers
+} RWLockDescriptor;
+
+// slot of a channel ring, sequence tells whether it is free or holds a message for the current lap
+typedef struct {
+    unsigned int sequence;
+    int message;
+} ChannelCell;
+
+typedef struct {
+    ChannelCell* cells; // ring of mask + 1 cells, a power of two
+    unsigned int mask;
+    bool single; // one sender and one receiver, no compare and swap needed
+    unsigned int sendPosition; // next cell to fill
+    unsigned int recvPosition; // next cell to empty
+    Queue senders; // processes blocked in channelSend because the ring is full
+    Queue receivers; // processes blocked in channelRecv because the ring is empty
+} ChannelDescriptor;
+
+// records posted by the interrupt routine of a vector, taken by the kernel
+typedef struct {
+    InterruptRecord records[INTERRUPT_RING_SIZE];
+    unsigned int head; // next record to take, written with interrupts disabled
+    unsigned int tail; // next record to post, written by the interrupt routine only
+    unsigned int lost; // records posted while the ring was full
+    bool armed; // a process has waited for the vector, its records are kept
+    Queue waiters; // processes blocked in waitInterrupt
+} InterruptRing;
+
+
+// Process that runs the tasks of a priority
+typedef struct {
+    TaskQueue ready; // tasks to resume
+    int process; // -1 until the first task of the priority is created
+    bool blocked; // the process waits for a task to be ready
+} TaskRunner;
+
+// Ready processes of a core, one list per priority level
+typedef struct {
+    Queue lists[PRIORITIES];
+    unsigned int priorities; // bit i is set when lists[i] is not empty
+} RunQueue;
+
 
 // Global variables
 
-// Pointer to the head of list of ready processes
-int readyList = -1;
+// Core the caller runs on, data of the running process is indexed by it
+#if KERNEL_CORES > 1
+#define THIS_CORE coreId()
+#else
+#define THIS_CORE 0
+#endif
+
+// Run queue of each core. The running processes are in none of them.
+ONCHIP_DATA RunQueue runQueues[KERNEL_CORES] = { [0 ... KERNEL_CORES - 1] = { { [0 ... PRIORITIES - 1] = EMPTY_QUEUE }, 0 } };
+
+// Processes a core took from the run queue of another one
+unsigned int stealCount = 0;
+
+// Ready periodic processes, a binary heap ordered by deadline shared by the cores
+ONCHIP_DATA int deadlineHeap[MAX_PERIODIC];
+int heapSize = 0;
+
+// Periodic processes that have not exited and the sum of their wcet / period
+int periodicCount = 0;
+unsigned int utilization = 0;
+
+// Id of the process running on each core, -1 before start()
+int runningProcesses[KERNEL_CORES] = { [0 ... KERNEL_CORES - 1] = -1 };
+#define currentProcess (runningProcesses[THIS_CORE])
+
+// Set while the kernel is called from the timer interrupt: the switch must
+// then save the full register frame
+bool inInterrupt = false;
+
+#ifdef KERNEL_STATS
+// Set when the running process is switched out although it could go on
+bool preempting = false;
+#endif
+
+// Run by each core when no other process is ready, they are in no ready list
+int idleProcesses[KERNEL_CORES] = { [0 ... KERNEL_CORES - 1] = -1 };
+#define idleProcess (idleProcesses[THIS_CORE])
+
+// The idle process replaced the periodic tick by one interrupt at the next deadline
+bool tickless = false;
+
+// slabs of process descriptors, slabCapacity entries in the table
+ProcessDescriptor** slabs = NULL;
+int slabCount = 0;
+int slabCapacity = 0;
+
+// descriptor of the process with index id
+#define PROCESS(id) (slabs[(id) >> SLAB_SHIFT][(id) & (SLAB_SIZE - 1)])
+
+#ifdef KERNEL_STATIC
+void idle();
+void setupStatic();
+
+// stacks of the processes of kernelConfig.h, placed where their entry says, and of the idle process
+#define STATIC_STACK(name, entry, stackSize, priority, ...) \
+    unsigned int staticStack_##name[(stackSize) / sizeof(unsigned int)] __attribute__((aligned(16))) __VA_ARGS__; \
+    _Static_assert((priority) >= 0 && (priority) < PRIORITIES, "invalid priority for " #name);
+KERNEL_PROCESSES(STATIC_STACK)
+unsigned int staticIdleStack[IDLE_STACK_SIZE / sizeof(unsigned int)] __attribute__((aligned(16)));
+
+// their descriptors, the idle process last, in whole slabs: the others are free
+#define STATIC_SLABS ((STATIC_PROCESSES + SLAB_SIZE) >> SLAB_SHIFT)
+#define STATIC_DESCRIPTOR(name, f, size, prio, ...) [name] = { \
+    .next = -1, .entry = f, .stack = staticStack_##name, \
+    .stackSize = sizeof(staticStack_##name), .stackClass = STATIC_STACK_CLASS, .alive = true, \
+    .joiners = EMPTY_QUEUE, .basePriority = prio, .priority = prio, \
+    .blockedOn = -1, .timerSlot = -1, .waitMonitor = -1 },
+#define staticStack_STATIC_PROCESSES staticIdleStack
+ONCHIP_DATA ProcessDescriptor staticDescriptors[STATIC_SLABS << SLAB_SHIFT] = {
+    KERNEL_PROCESSES(STATIC_DESCRIPTOR)
+    STATIC_DESCRIPTOR(STATIC_PROCESSES, idle, IDLE_STACK_SIZE, PRIORITIES)
+};
+ProcessDescriptor* staticSlabs[STATIC_SLABS];
+#endif
+
+// unused descriptors, chained through next
+Queue freeDescriptors = EMPTY_QUEUE;
+
+// number of processes that have not exited yet
+int liveProcesses = 0;
+
+// freed stacks of each size class, chained through their first word
+unsigned int* stackPools[STACK_CLASSES];
+
+// stack of the last process that exited, released once we run on another stack
+unsigned int* exitedStack = NULL;
+int exitedStackClass;
+
+// bytes obtained from malloc for stacks and descriptors, never given back
+unsigned int heapUsage = 0;
+
+// number of context switches since start()
+unsigned int switchCount = 0;
+
+// list of monitor descriptors
+#ifdef KERNEL_STATIC
+#define STATIC_MONITOR(name) [name] = { EMPTY_QUEUE, EMPTY_QUEUE, 0, 0 },
+ONCHIP_DATA MonitorDescriptor monitors[MAX_MONITORS] = { KERNEL_MONITORS(STATIC_MONITOR) };
+int nextMonitorID = STATIC_MONITORS;
+_Static_assert(STATIC_MONITORS <= MAX_MONITORS, "too many monitors in kernelConfig.h");
+#else
+ONCHIP_DATA MonitorDescriptor monitors[MAX_MONITORS];
+int nextMonitorID = 0;
+#endif
+
+// Timer wheel, each slot is a list of processes chained through timerNext
+ONCHIP_DATA int timerWheel[WHEEL_LEVELS * WHEEL_SIZE] = { [0 ... WHEEL_LEVELS * WHEEL_SIZE - 1] = -1 };
+// next tick handled by the timer wheel
+unsigned int kernelTicks = 0;
 
-// list of process descriptors
-ProcessDescriptor processes[MAXPROCESS];
-int nextProcessId = 0;
+// Runner of the tasks of each priority
+TaskRunner runners[PRIORITIES] = { [0 ... PRIORITIES - 1] = { { NULL, NULL }, -1, false } };
+// Tasks in TASK_SLEEP, in the slot of their expiry tick: a slot holds the tasks of every lap
+ONCHIP_DATA Task* taskWheel[WHEEL_SIZE];
 
 /***********************************************************
  ***********************************************************
@@ -47,411 +344,3020 @@ int nextProcessId = 0;
             ************************************************************
             * **********************************************************/
 
+// empty the list
+void initQueue(Queue* list) {
+    list->head = -1;
+    list->tail = -1;
+}
+
 // add element to the tail of the list
-void addLast(int* list, int processId) {
+ONCHIP_CODE void addLast(Queue* list, int processId) {
     if(processId == -1)
     {
         return;
     }
-    if (*list == -1){
+    TRACE(TRACE_ENQUEUE, processId, list);
+    // the element may come from another list, never keep its old successor
+    PROCESS(processId).next = -1;
+    if (list->head == -1){
         // list is empty
-        *list = processId;
+        list->head = processId;
     }
     else {
-        int temp = *list;
-        while (processes[temp].next != -1){
-            temp = processes[temp].next;
-        }
-        processes[temp].next = processId;
-        processes[processId].next = -1;
+        PROCESS(list->tail).next = processId;
     }
-
+    list->tail = processId;
 }
 
 // add element to the head of list
-void addFirst(int* list, int processId){
+ONCHIP_CODE void addFirst(Queue* list, int processId){
     if(processId == -1)
     {
         return;
     }
-    if (*list == -1){
-        *list = processId;
-    }
-    else {
-        processes[processId].next = *list;
-        *list = processId;
+    TRACE(TRACE_ENQUEUE, processId, list);
+    PROCESS(processId).next = list->head;
+    if (list->head == -1){
+        list->tail = processId;
     }
+    list->head = processId;
 }
 
 // remove element that is head of the list
-int removeHead(int* list){
-    if (*list == -1){
+ONCHIP_CODE int removeHead(Queue* list){
+    if (list->head == -1){
         return(-1); // we modified it so that it returns -1 if there is no element to remove
     }
     else {
-        int head = *list;
-        int next = processes[*list].next;
-        processes[*list].next = -1;
-        *list = next;
+        int head = list->head;
+        TRACE(TRACE_DEQUEUE, head, list);
+        list->head = PROCESS(head).next;
+        if (list->head == -1){
+            list->tail = -1;
+        }
+        PROCESS(head).next = -1;
         return head;
     }
 }
 
 // returns head of the list
-int head(int* list){
-    if (*list == -1){
-        return(-1);
+int head(Queue* list){
+    return list->head;
+}
+
+// remove an element from anywhere in the list, linear in its position, false if it is not in it
+bool removeFromList(Queue* list, int processId){
+    int previous = -1;
+    int temp = list->head;
+    while (temp != -1 && temp != processId){
+        previous = temp;
+        temp = PROCESS(temp).next;
+    }
+    if (temp == -1){
+        return false;
+    }
+    TRACE(TRACE_DEQUEUE, temp, list);
+    if (previous == -1){
+        list->head = PROCESS(temp).next;
     }
     else {
-        return *list;
+        PROCESS(previous).next = PROCESS(temp).next;
+    }
+    if (list->tail == temp){
+        list->tail = previous;
     }
+    PROCESS(temp).next = -1;
+    return true;
 }
 
-/***********************************************************
- ***********************************************************
-                    Kernel functions
-                    ************************************************************
-                    * **********************************************************/
-
-void createProcess (void (*f)(), int stackSize) {
-    if (nextProcessId == MAXPROCESS){
-        printf("Error: Maximum number of processes reached!\n");
-        exit(1);
+// move all elements of other to the tail of the list, other is left empty
+void addAll(Queue* list, Queue* other){
+    if (other->head == -1){
+        return;
     }
-
-    Process process;
-    unsigned int* stack = malloc(stackSize);
-    process = newProcess(f, stack, stackSize);
-    processes[nextProcessId].next = -1;
-    processes[nextProcessId].p = process;
-    processes[nextProcessId].m_sp = 0;
-
-    // add process to the list of ready Processes
-    addLast(&readyList, nextProcessId);
-    nextProcessId++;
-
+    TRACE(TRACE_SPLICE, other->head, list);
+    if (list->head == -1){
+        list->head = other->head;
+    }
+    else {
+        PROCESS(list->tail).next = other->head;
+    }
+    list->tail = other->tail;
+    initQueue(other);
 }
 
+// add a task to the tail of the list
+void appendTask(TaskQueue* list, Task* task){
+    task->next = NULL;
+    if (list->head == NULL){
+        list->head = task;
+    }
+    else {
+        list->tail->next = task;
+    }
+    list->tail = task;
+}
 
-void yield(){
-    int pId = removeHead(&readyList);
-    addLast(&readyList, pId);
-    Process process = processes[head(&readyList)].p;
-    transfer(process);
+// move all tasks of other to the tail of the list, other is left empty
+void addAllTasks(TaskQueue* list, TaskQueue* other){
+    if (other->head == NULL){
+        return;
+    }
+    if (list->head == NULL){
+        list->head = other->head;
+    }
+    else {
+        list->tail->next = other->head;
+    }
+    list->tail = other->tail;
+    other->head = NULL;
+    other->tail = NULL;
 }
 
-void start(){
+// empties a list of tasks and returns its head, the tasks stay chained
+Task* takeTasks(TaskQueue* list){
+    Task* first = list->head;
+    list->head = NULL;
+    list->tail = NULL;
+    return first;
+}
 
-    printf("Starting kernel...\n");
-    if (readyList == -1){
-        printf("Error: No process in the ready list!\n");
-        exit(1);
+// atomically replace *p by value if it is expected, safe against interrupt routines
+static inline bool compareAndSwap(unsigned int* p, unsigned int expected, unsigned int value)
+{
+#ifdef __nios2__
+    // single core: masking interrupts is enough
+    bool swapped = false;
+    int status = disableInterrupts();
+    if(*(volatile unsigned int*) p == expected)
+    {
+        *(volatile unsigned int*) p = value;
+        swapped = true;
     }
-    Process process = processes[head(&readyList)].p;
-    transfer(process);
+    restoreInterrupts(status);
+    return swapped;
+#else
+    return __atomic_compare_exchange_n(p, &expected, value, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+#endif
 }
 
+// id of the running process for the paths that run with interrupts enabled:
+// a process preempted between reading the core and its running process may
+// resume on another one, then the core is read again. Only core 0 takes the
+// interrupts, a process cannot move twice meanwhile.
+static inline int runningProcess(void)
+{
+#if KERNEL_CORES > 1
+    int core, process;
+    do
+    {
+        core = THIS_CORE;
+        process = runningProcesses[core];
+    } while(core != THIS_CORE);
+    return process;
+#else
+    return currentProcess;
+#endif
+}
 
-/**
- * Monitor related kernel functions
- **/
-
-MonitorDescriptor monitors[MAX_MONITORS];
-int nextMonitorID = 0;
+/***********************************************************
+ ***********************************************************
+                    Descriptors and stacks
+                    ************************************************************
+                    * **********************************************************/
 
 /**
- * Returns true if the pid has entered into the monitor with id mid at
- * least once
+ * Returns a descriptor index from the free list, adding a slab if it is empty.
  **/
-bool hasMonitor(int pid, int mid)
+int allocateDescriptor()
 {
     int i;
-    for(i = 0 ; i < MAX_MONITORS ; i++)
+
+#ifdef KERNEL_STATIC
+    if(slabs == NULL)
     {
-        if(processes[pid].monitors[i] == mid)
+        setupStatic(); // the static processes take the first ids
+    }
+#endif
+    if(head(&freeDescriptors) == -1)
+    {
+        if(slabCount << SLAB_SHIFT == MAX_PROCESSES)
         {
-            return true;
+            printf("Error: Maximum number of processes reached!\n");
+            exit(1);
+        }
+        if(slabCount == slabCapacity)
+        {
+            slabCapacity = slabCapacity ? 2 * slabCapacity : 4;
+            // the other cores read the table without the kernel lock (PROCESS on
+            // the monitor fast paths), the old one must stay valid
+            bool keep = KERNEL_CORES > 1 && slabs != NULL;
+#ifdef KERNEL_STATIC
+            // the table of the static slabs cannot be reallocated
+            keep = keep || slabs == staticSlabs;
+#endif
+            if(keep)
+            {
+                ProcessDescriptor** table = malloc(slabCapacity * sizeof(ProcessDescriptor*));
+                if(table != NULL)
+                {
+                    memcpy(table, slabs, slabCount * sizeof(ProcessDescriptor*));
+                }
+                slabs = table;
+            }
+            else
+            {
+                slabs = realloc(slabs, slabCapacity * sizeof(ProcessDescriptor*));
+            }
+        }
+        if(slabs == NULL || (slabs[slabCount] = calloc(SLAB_SIZE, sizeof(ProcessDescriptor))) == NULL)
+        {
+            printf("Error: Out of memory for process descriptors!\n");
+            exit(1);
+        }
+        heapUsage += SLAB_SIZE * sizeof(ProcessDescriptor);
+        for(i = 0 ; i < SLAB_SIZE ; i++)
+        {
+            addLast(&freeDescriptors, (slabCount << SLAB_SHIFT) + i);
         }
+        slabCount++;
     }
-    return false;
+    return removeHead(&freeDescriptors);
 }
 
 /**
- * Returns the element on top of the monitor stack of a process without deleting it from the stack.
+ * Returns the size class of a stack, STACK_CLASSES if it is too big to be pooled.
  **/
-int peekMonitor(ProcessDescriptor *p)
+int stackClass(int stackSize)
 {
-    if(p->m_sp == 0)
+    int c = 0;
+    while(c < STACK_CLASSES && (1 << (c + MIN_STACK_SHIFT)) < stackSize)
     {
-        return -1;
+        c++;
     }
-    return p->monitors[p->m_sp - 1];
+    return c;
 }
 
 /**
- * Returns and delete the element on top of a process' monitor's stack.
+ * Takes a stack of the given class from its pool, only calls malloc when
+ * the pool is empty.
  **/
-int popMonitor(ProcessDescriptor *p)
+unsigned int* allocateStack(int c, int stackSize)
 {
-    if(p->m_sp == -1) //Nothing to pop
+    unsigned int* stack;
+
+    if(c < STACK_CLASSES && stackPools[c] != NULL)
     {
-        return -1;
+        stack = stackPools[c];
+        stackPools[c] = *(unsigned int**) stack;
+        return stack;
     }
-    return p->monitors[--(p->m_sp)];
+    if(c < STACK_CLASSES)
+    {
+        stackSize = 1 << (c + MIN_STACK_SHIFT);
+    }
+    stack = malloc(stackSize);
+    if(stack == NULL)
+    {
+        printf("Error: Out of memory for a stack of %d bytes!\n", stackSize);
+        exit(1);
+    }
+    heapUsage += stackSize;
+    return stack;
 }
 
-/**
- * Add an element on at the top of a process' monitor's stack.
- **/
-void pushMonitor(ProcessDescriptor *p, int monitorId)
+void releaseStack(unsigned int* stack, int c)
 {
-    if(p->m_sp == MAX_MONITORS)
+    if(c == STATIC_STACK_CLASS)
     {
-        fprintf(stderr, "Process has too many imbricated monitor calls\n");
-        exit(EXIT_FAILURE);
+        return;
     }
-    p->monitors[p->m_sp++] = monitorId;
+    if(c == STACK_CLASSES)
+    {
+        free(stack);
+        return;
+    }
+    *(unsigned int**) stack = stackPools[c];
+    stackPools[c] = stack;
 }
 
 /**
- * Returns true if process p is in monitor monitorId
+ * Puts the canary at the low end of a new stack, which grows towards it.
+ * With KERNEL_STACK_CHECK the rest is painted for stackHighWater.
  **/
-bool isInMonitor(ProcessDescriptor *p, int monitorId)
+void prepareStack(unsigned int* stack, int stackSize)
 {
+#ifdef KERNEL_STACK_CHECK
     int i;
-    for(i = p->m_sp ; i >= 0 ; i--)
+    for(i = 1; i < stackSize / (int) sizeof(unsigned int); i++)
     {
-        if(p->monitors[i] == monitorId)
-        {
-            return true;
-        }
+        stack[i] = STACK_PAINT;
     }
-    return false;
+#else
+    (void) stackSize;
+#endif
+    stack[0] = STACK_CANARY;
 }
 
 /**
- * initialize a new monitor if there isn't aready too many of them.
+ * Gives the stack of the last exited process back to its pool. Must not be
+ * called on that stack.
  **/
-int createMonitor()
+void releaseExitedStack()
 {
-    if(nextMonitorID >= MAX_MONITORS)
+    if(exitedStack != NULL)
     {
-    	fprintf(stderr, "There is already too many Monitors!\n");
-    	exit(1);
+        releaseStack(exitedStack, exitedStackClass);
+        exitedStack = NULL;
     }
+}
 
-    monitors[nextMonitorID].waitingList = -1; // waiting list is yet empty
-    monitors[nextMonitorID].readyList = -1; // ready list is yet empty
-    monitors[nextMonitorID].locked = false; // there is no process in this event yet
+/***********************************************************
+ ***********************************************************
+                    Statistics
+                    ************************************************************
+                    * **********************************************************/
+
+#ifdef KERNEL_STATS
+enum { STATE_RUNNING, STATE_READY, STATE_BLOCKED };
+
+// adds the time since the last change of state to the counter of the state
+static void accountState(ProcessDescriptor *proc, unsigned int now)
+{
+    unsigned int elapsed = now - proc->stateSince;
+    if (proc->state == STATE_RUNNING){
+        proc->stats.runningCycles += elapsed;
+    }
+    else if (proc->state == STATE_READY){
+        proc->stats.readyCycles += elapsed;
+    }
+    else {
+        proc->stats.blockedCycles += elapsed;
+    }
+    proc->stateSince = now;
+}
 
-    return nextMonitorID++;
+static void setState(ProcessDescriptor *proc, int state, unsigned int now)
+{
+    accountState(proc, now);
+    proc->state = state;
 }
 
-/**
- * Tries to enter the given monitor depending if it's locked or not.
- **/
-void enterMonitor(int monitorId)
+// a new process, about to be made ready
+static void statsCreated(ProcessDescriptor *proc)
 {
-    ProcessDescriptor *proc = &(processes[head(&readyList)]);
+    memset(&(proc->stats), 0, sizeof(ProcessStats));
+    proc->state = STATE_READY;
+    proc->stateSince = read_timestamp();
+    proc->woken = false;
+}
 
-    bool alreadyLocked;
+// the process goes to a ready list
+static void statsReady(int pid)
+{
+    ProcessDescriptor *proc = &(PROCESS(pid));
+    if (proc->state == STATE_READY){
+        return; // moved between ready lists
+    }
+    proc->woken = proc->state == STATE_BLOCKED;
+    if (proc->woken){
+        proc->stats.wakeups++;
+    }
+    setState(proc, STATE_READY, read_timestamp());
+}
 
-    if(monitorId < 0 || monitorId >= nextMonitorID)
-    {
-    	fprintf(stderr, "Invalid monitorId!\n");
+// the processor goes from previous (-1 before start) to next
+static void statsSwitch(int previous, int next)
+{
+    bool involuntary = preempting || inInterrupt;
+    preempting = false;
+    if (next == previous){
         return;
     }
 
-    alreadyLocked = isInMonitor(proc, monitorId);
-
-    pushMonitor(proc, monitorId);
-
-    if(!alreadyLocked) //If we don't already have the lock of this monitor
-    {
-        if(monitors[monitorId].locked) //And if it's locked somewhere else
-        {
-
-            addLast(&(monitors[monitorId].readyList), removeHead(&readyList)); // we put the current process in the readyList
-            transfer(processes[head(&readyList)].p); // we transfer control to another process.
+    unsigned int now = read_timestamp();
+    ProcessDescriptor *proc;
+    if (previous != -1){
+        proc = &(PROCESS(previous));
+        if (involuntary){
+            proc->stats.involuntarySwitches++;
         }
-        else // else if it's unlocked, we take it for this process and lock it.
-        {
-            monitors[monitorId].locked = true;
+        else {
+            proc->stats.voluntarySwitches++;
         }
+        setState(proc, proc->ready ? STATE_READY : STATE_BLOCKED, now);
+    }
+
+    proc = &(PROCESS(next));
+    if (proc->woken){
+        unsigned int latency = (now - proc->stateSince) >> LATENCY_SHIFT;
+        int bucket = latency ? 32 - __builtin_clz(latency) : 0;
+        proc->stats.latency[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+        proc->woken = false;
     }
+    setState(proc, STATE_RUNNING, now);
 }
 
-/**
- * Wait to be notified by a given monitor
- **/
-void wait()
+// the outermost entry in a monitor, contended if the process had to queue
+static void monitorAcquired(MonitorDescriptor *m)
 {
-    ProcessDescriptor *proc = &(processes[head(&readyList)]);
-    int monitorId = peekMonitor(proc);
+    m->stats.entries++;
+    m->acquiredAt = read_timestamp();
+}
 
-    if(monitorId == -1)
-    {
-    	fprintf(stderr, "Error: Process is in no monitors\n");
-        return;
+static void monitorReleased(MonitorDescriptor *m)
+{
+    unsigned int held = read_timestamp() - m->acquiredAt;
+    m->stats.holdCycles += held;
+    if (held > m->stats.maxHoldCycles){
+        m->stats.maxHoldCycles = held;
     }
+}
+#endif
 
-    // if there is no other process ready to run in this monitor, we unlock the monitor
-    if(head(&(monitors[monitorId].readyList)) == -1)
-    {
-        monitors[monitorId].locked = false;
-    }
+/***********************************************************
+ ***********************************************************
+                    Scheduler
+                    ************************************************************
+                    * **********************************************************/
 
-    // we add our process to the waiting list of the given monitor
-    addLast(&(monitors[monitorId].waitingList), removeHead(&readyList));
+void leaveTickless(bool onTick);
+
+// index of the lowest bit set in a non zero word
+static inline int findFirstSet(unsigned int word) {
+#if defined(__nios2__)
+    // no custom instruction for it on our core, binary search instead of
+    // the libgcc loop
+    int bit = 0;
+    if ((word & 0xffff) == 0) { bit += 16; word >>= 16; }
+    if ((word & 0xff) == 0) { bit += 8; word >>= 8; }
+    if ((word & 0xf) == 0) { bit += 4; word >>= 4; }
+    if ((word & 0x3) == 0) { bit += 2; word >>= 2; }
+    if ((word & 0x1) == 0) { bit += 1; }
+    return bit;
+#else
+    return __builtin_ctz(word);
+#endif
+}
 
-    // we transfer control to another process (and add head of this monitor readylist if there is one)
-    addLast(&readyList, removeHead(&(monitors[monitorId].readyList)));
-    transfer(processes[head(&readyList)].p);
+// true if the current job of process a has an earlier deadline than the one of b
+static inline bool earlier(int a, int b) {
+    return (int) (PROCESS(a).deadline - PROCESS(b).deadline) < 0;
 }
 
-/**
- * Notify a process from the waitingList of the current monitor
- **/
-void notify()
-{
-    ProcessDescriptor *proc = &(processes[head(&readyList)]);
-    int monitorId = peekMonitor(proc);
+static inline void heapPlace(int index, int processId) {
+    deadlineHeap[index] = processId;
+    PROCESS(processId).heapIndex = index;
+}
 
-    if(monitorId == -1)
-    {
-    	fprintf(stderr, "Error: Process is in no monitors\n");
-        return;
+// move the process at index up or down the deadline heap to its place
+ONCHIP_CODE static void heapFix(int index) {
+    int processId = deadlineHeap[index];
+    int child;
+
+    while (index > 0 && earlier(processId, deadlineHeap[(index - 1) / 2])){
+        heapPlace(index, deadlineHeap[(index - 1) / 2]);
+        index = (index - 1) / 2;
+    }
+    while ((child = 2 * index + 1) < heapSize){
+        if (child + 1 < heapSize && earlier(deadlineHeap[child + 1], deadlineHeap[child])){
+            child++;
+        }
+        if (!earlier(deadlineHeap[child], processId)){
+            break;
+        }
+        heapPlace(index, deadlineHeap[child]);
+        index = child;
     }
+    heapPlace(index, processId);
+}
 
-    // we transfer the head of its waitingList to its readyList.
-    addLast(&(monitors[monitorId].readyList),
-            removeHead(&(monitors[monitorId].waitingList)));
+ONCHIP_CODE static void heapInsert(int processId) {
+    heapPlace(heapSize++, processId);
+    heapFix(heapSize - 1);
 }
 
-/**
- * Notify all processes waiting on the current monitor
- **/
-void notifyAll()
-{
-    ProcessDescriptor *proc = &(processes[head(&readyList)]);
-    int monitorId = peekMonitor(proc);
+ONCHIP_CODE static void heapRemove(int processId) {
+    int index = PROCESS(processId).heapIndex;
 
-    if(monitorId == -1)
-    {
-    	fprintf(stderr, "Error: Process is in no monitors\n");
-        return;
+    if (--heapSize > index){
+        heapPlace(index, deadlineHeap[heapSize]);
+        heapFix(index);
     }
+}
 
-    // we put every process of the waitingList in the readyList of the current monitor.
-    while(head(&(monitors[monitorId].waitingList)) != -1)
-    {
-        addLast(&(monitors[monitorId].readyList),
-                removeHead(&(monitors[monitorId].waitingList)));
+// put a process at the tail of the ready list of its priority, in the run queue of its core
+// (a periodic process goes to the deadline heap)
+ONCHIP_CODE void makeReady(int processId) {
+    if (processId == -1){
+        return;
+    }
+    STATS(statsReady(processId));
+    ProcessDescriptor *proc = &(PROCESS(processId));
+    proc->ready = true;
+    if (proc->priority == REALTIME_PRIORITY){
+        heapInsert(processId);
+        return;
     }
+    RunQueue *rq = &(runQueues[proc->core]);
+    addLast(&(rq->lists[proc->priority]), processId);
+    rq->priorities |= 1u << proc->priority;
 }
 
-/**
- * Leaves the current monitor section
- **/
-void exitMonitor()
-{
-    ProcessDescriptor *proc = &(processes[head(&readyList)]);
-    int monitorId = popMonitor(proc);
-
-    if(monitorId == -1)
-    {
-    	fprintf(stderr, "Error: Process is in no monitors\n");
+// put a process at the head of the ready list of its priority
+ONCHIP_CODE void makeReadyFirst(int processId) {
+    STATS(statsReady(processId));
+    ProcessDescriptor *proc = &(PROCESS(processId));
+    proc->ready = true;
+    if (proc->priority == REALTIME_PRIORITY){
+        heapInsert(processId);
         return;
     }
+    RunQueue *rq = &(runQueues[proc->core]);
+    addFirst(&(rq->lists[proc->priority]), processId);
+    rq->priorities |= 1u << proc->priority;
+}
 
-    // If there is no more ready process for the current monitor
-    if(head(&(monitors[monitorId].readyList)) == -1)
-    {
-        if(!isInMonitor(proc, monitorId)) // And this monitor is no longer in the stack of the current process
-        {
-            monitors[monitorId].locked = false; // We unlock.
-        }
+// take a process out of the ready list it is in
+ONCHIP_CODE void removeReady(int processId) {
+    ProcessDescriptor *proc = &(PROCESS(processId));
+    proc->ready = false;
+    if (proc->priority == REALTIME_PRIORITY){
+        heapRemove(processId);
+        return;
     }
-    // If there is still ready process, we put the head of the monitor's readyList in the kernel readyList and we do not unlock the monitor
-    else
-    {
-        addLast(&readyList,
-                removeHead(&(monitors[monitorId].readyList)));
+    RunQueue *rq = &(runQueues[proc->core]);
+    removeFromList(&(rq->lists[proc->priority]), processId);
+    if (head(&(rq->lists[proc->priority])) == -1){
+        rq->priorities &= ~(1u << proc->priority);
     }
 }
 
-/**
- * Event related kernel functions
- **/
+// change the effective priority of a process, keeping the ready lists sorted
+void changePriority(int processId, int priority) {
+    if (PROCESS(processId).ready){
+        removeReady(processId);
+        PROCESS(processId).priority = priority;
+        makeReady(processId);
+    }
+    else {
+        PROCESS(processId).priority = priority;
+    }
+}
 
-// list of event descriptors
-EventDescriptor events[MAX_EVENTS];
-int nextEventID = 0;
+// put a task in the ready list of its runner, which is made ready if it waits for one
+ONCHIP_CODE void wakeTask(Task* task) {
+    TaskRunner *r = &(runners[task->priority]);
 
-/**
- * We create a new event if we haven't reached the max amount of them
- **/
-int createEvent()
-{
-    // We check if we haven't reached the max amount of events yet
-    if(nextEventID == MAX_EVENTS)
-    {
-        printf("Error: No more events available\n");
-        exit(1);
+    appendTask(&(r->ready), task);
+    if (r->blocked){
+        r->blocked = false;
+        makeReady(r->process);
     }
-    events[nextEventID].waitingList = -1; // no process are waiting yet
-    events[nextEventID].happened = false; // event hasn't happened yet
-
-    return nextEventID++; // return the ID of the newly created event
+}
+
+void wakeTasks(TaskQueue* list) {
+    Task* task = takeTasks(list);
+
+    while (task != NULL){
+        Task* next = task->next;
+        wakeTask(task);
+        task = next;
+    }
+}
+
+// priority of the best process of a run queue, PRIORITIES if there is none
+static inline int queuePriority(RunQueue *rq) {
+    if (rq->priorities == 0){
+        return PRIORITIES;
+    }
+    return findFirstSet(rq->priorities);
+}
+
+/**
+ * Priority of the best ready process, REALTIME_PRIORITY if a periodic
+ * process is ready, PRIORITIES if there is none. The processes of the
+ * other cores count: any core may steal them.
+ **/
+ONCHIP_CODE int highestReady() {
+    if (heapSize > 0){
+        return REALTIME_PRIORITY;
+    }
+#if KERNEL_CORES > 1
+    unsigned int priorities = 0;
+    int core;
+    for (core = 0; core < KERNEL_CORES; core++){
+        priorities |= runQueues[core].priorities;
+    }
+    if (priorities == 0){
+        return PRIORITIES;
+    }
+    return findFirstSet(priorities);
+#else
+    return queuePriority(&runQueues[0]);
+#endif
+}
+
+/**
+ * Removes the best ready process from its ready list. A core takes it from
+ * its own run queue unless another core has a better one, which it steals.
+ **/
+ONCHIP_CODE int takeReady() {
+    if (heapSize > 0){
+        int processId = deadlineHeap[0];
+        heapRemove(processId);
+        PROCESS(processId).ready = false;
+        return processId;
+    }
+    RunQueue *rq = &(runQueues[THIS_CORE]);
+    int priority = queuePriority(rq);
+#if KERNEL_CORES > 1
+    int core;
+    for (core = 0; core < KERNEL_CORES; core++){
+        if (queuePriority(&runQueues[core]) < priority){
+            rq = &(runQueues[core]);
+            priority = queuePriority(rq);
+        }
+    }
+    if (rq != &(runQueues[THIS_CORE])){
+        stealCount++;
+    }
+#endif
+    if (priority == PRIORITIES){
+        return -1;
+    }
+    int processId = removeHead(&(rq->lists[priority]));
+    if (head(&(rq->lists[priority])) == -1){
+        rq->priorities &= ~(1u << priority);
+    }
+    PROCESS(processId).ready = false;
+    return processId;
+}
+
+/**
+ * Gives the processor to a process that is in no list. The running process
+ * must already have been put in the list it belongs to (ready or waiting).
+ **/
+ONCHIP_CODE void switchTo(int next) {
+    PROCESS(next).sliceLeft = PROCESS(next).quantum;
+    STATS(statsSwitch(currentProcess, next));
+    if (next == currentProcess){
+        return;
+    }
+    if (currentProcess != -1 && *(PROCESS(currentProcess).stack) != STACK_CANARY){
+        printf("Error: Process %d overflowed its stack of %d bytes!\n",
+                currentProcess, PROCESS(currentProcess).stackSize);
+        exit(1);
+    }
+    TRACE(TRACE_SWITCH, currentProcess, next);
+    currentProcess = next;
+#if KERNEL_CORES > 1
+    PROCESS(next).core = THIS_CORE;
+#endif
+    switchCount++;
+    if (inInterrupt){
+        inInterrupt = false;
+        transfer(PROCESS(next).p);
+    }
+    else {
+        transferVoluntary(PROCESS(next).p);
+    }
+    releaseExitedStack();
+}
+
+/**
+ * Gives the processor to the best ready process. The running process must
+ * already have been put in the list it belongs to (ready or waiting).
+ **/
+ONCHIP_CODE void dispatch() {
+    int next = takeReady();
+    if (next == -1){
+        next = idleProcess;
+    }
+    if (next == -1){
+        printf("Error: No process in the ready list!\n");
+        exit(1);
+    }
+    switchTo(next);
+}
+
+/**
+ * True if the best ready process must run before processId, or may take
+ * turns with it if orEqual is true. Periodic processes compare deadlines.
+ **/
+ONCHIP_CODE bool readyBeats(int processId, bool orEqual) {
+    int best = highestReady();
+    int priority = PROCESS(processId).priority;
+
+    if (best == REALTIME_PRIORITY && priority == REALTIME_PRIORITY){
+        int lead = PROCESS(processId).deadline - PROCESS(deadlineHeap[0]).deadline;
+        return lead > 0 || (orEqual && lead == 0);
+    }
+    return best < priority || (orEqual && best == priority);
+}
+
+/**
+ * Called after processes have been made ready: the running process goes
+ * back to the head of its ready list if one of them has a higher priority.
+ **/
+ONCHIP_CODE void preempt() {
+    if (currentProcess != -1 && readyBeats(currentProcess, false)){
+        if (currentProcess != idleProcess){
+            makeReadyFirst(currentProcess);
+        }
+        else if (tickless){
+            leaveTickless(false);
+        }
+        STATS(preempting = true);
+        dispatch();
+    }
+}
+
+/**
+ * End of the time slice of the running process: it goes to the tail of its
+ * ready list if another process of the same priority is ready.
+ **/
+ONCHIP_CODE void endSlice() {
+    PROCESS(currentProcess).slicePending = false;
+    if (readyBeats(currentProcess, true)){
+        makeReady(currentProcess);
+        STATS(preempting = true);
+        dispatch();
+    }
+    else {
+        PROCESS(currentProcess).sliceLeft = PROCESS(currentProcess).quantum;
+    }
+}
+
+/***********************************************************
+ ***********************************************************
+                    Timers
+                    ************************************************************
+                    * **********************************************************/
+
+void updatePriority(int pid);
+bool acquireOrContend(MonitorDescriptor *m, int pid);
+
+// put the timer of a process in the slot its expiry falls in
+ONCHIP_CODE void addTimer(int pid) {
+    ProcessDescriptor *p = &(PROCESS(pid));
+    unsigned int expiry = p->timerExpiry;
+    unsigned int delta = expiry - kernelTicks;
+    int level = 0;
+    int slot;
+
+    if ((int) delta < 0){
+        // late, handled by the next tick
+        expiry = kernelTicks;
+        delta = 0;
+    }
+    else if (delta >= 1u << (WHEEL_LEVELS * WHEEL_BITS)){
+        // too far, it will be put back in the wheel when the last level cascades
+        expiry = kernelTicks + (1u << (WHEEL_LEVELS * WHEEL_BITS)) - 1;
+        delta = expiry - kernelTicks;
+    }
+    while (delta >= 1u << ((level + 1) * WHEEL_BITS)){
+        level++;
+    }
+    slot = level * WHEEL_SIZE + ((expiry >> (level * WHEEL_BITS)) & WHEEL_MASK);
+
+    p->timerSlot = slot;
+    p->timerPrev = -1;
+    p->timerNext = timerWheel[slot];
+    if (timerWheel[slot] != -1){
+        PROCESS(timerWheel[slot]).timerPrev = pid;
+    }
+    timerWheel[slot] = pid;
+}
+
+// take the timer of a process out of the wheel, if it is armed
+void cancelTimer(int pid) {
+    ProcessDescriptor *p = &(PROCESS(pid));
+
+    if (p->timerSlot == -1){
+        return;
+    }
+    if (p->timerPrev == -1){
+        timerWheel[p->timerSlot] = p->timerNext;
+    }
+    else {
+        PROCESS(p->timerPrev).timerNext = p->timerNext;
+    }
+    if (p->timerNext != -1){
+        PROCESS(p->timerNext).timerPrev = p->timerPrev;
+    }
+    p->timerSlot = -1;
+}
+
+/**
+ * Arms the timer of the running process for a blocking call: after ticks
+ * timer ticks, it is taken out of waitingOn (if it is still in it) and made
+ * ready. A negative number of ticks waits forever.
+ **/
+void armTimeout(int ticks, Queue* waitingOn, int waitMonitor) {
+    ProcessDescriptor *p = &(PROCESS(currentProcess));
+
+    p->timedOut = false;
+    if (ticks < 0){
+        return;
+    }
+    p->waitingOn = waitingOn;
+    p->waitMonitor = waitMonitor;
+    // the tick being counted is the first one
+    p->timerExpiry = kernelTicks + ticks - 1;
+    addTimer(currentProcess);
+}
+
+// to be called once the process runs again, returns true if the timer expired
+bool endTimeout() {
+    cancelTimer(currentProcess);
+    return PROCESS(currentProcess).timedOut;
+}
+
+/**
+ * The timer of a process expired: it stops waiting unless it has been woken
+ * up meanwhile and has not run yet.
+ **/
+ONCHIP_CODE void timerExpired(int pid) {
+    ProcessDescriptor *p = &(PROCESS(pid));
+
+    p->timerSlot = -1;
+    if (p->waitingOn != NULL){
+        // linear in the position in the queue, only paid on a timeout
+        if (!removeFromList(p->waitingOn, pid)){
+            return;
+        }
+        p->timedOut = true;
+        if (p->blockedOn != -1){
+            // it no longer waits to enter the monitor, its owner no longer inherits from it
+            int monitorId = p->blockedOn;
+            p->blockedOn = -1;
+            updatePriority(LOCK_OWNER(monitors[monitorId].lock));
+        }
+        if (p->waitMonitor != -1){
+            // waitTimeout returns in the monitor, like after notify
+            MonitorDescriptor *m = &(monitors[p->waitMonitor]);
+            if (!acquireOrContend(m, pid)){
+                addLast(&(m->readyList), pid);
+                p->blockedOn = p->waitMonitor;
+                updatePriority(LOCK_OWNER(m->lock));
+                return;
+            }
+        }
+    }
+    makeReady(pid);
+}
+
+// put the timers of a slot of an upper level back in the wheel, returns the slot index
+ONCHIP_CODE int cascade(int level) {
+    int index = (kernelTicks >> (level * WHEEL_BITS)) & WHEEL_MASK;
+    int slot = level * WHEEL_SIZE + index;
+    int pid = timerWheel[slot];
+
+    timerWheel[slot] = -1;
+    while (pid != -1){
+        int next = PROCESS(pid).timerNext;
+        addTimer(pid);
+        pid = next;
+    }
+    return index;
+}
+
+/**
+ * Expires the timers of the current tick. Each timer is moved at most
+ * WHEEL_LEVELS - 1 times before it expires, so a tick is O(1) amortized.
+ **/
+ONCHIP_CODE void advanceTimers() {
+    int index = kernelTicks & WHEEL_MASK;
+    int level = 1;
+    int pid;
+    Task** link;
+
+    // when a level wraps around, the next slot of the level above is spread below
+    while (index == 0 && level < WHEEL_LEVELS){
+        index = cascade(level++);
+    }
+    index = kernelTicks & WHEEL_MASK;
+    pid = timerWheel[index];
+    timerWheel[index] = -1;
+    while (pid != -1){
+        int next = PROCESS(pid).timerNext;
+        timerExpired(pid);
+        pid = next;
+    }
+    // the tasks of the slot that are a lap or more ahead stay in it
+    link = &(taskWheel[index]);
+    while (*link != NULL){
+        Task* task = *link;
+        if ((int) (task->timerExpiry - kernelTicks) <= 0){
+            *link = task->next;
+            wakeTask(task);
+        }
+        else {
+            link = &(task->next);
+        }
+    }
+    kernelTicks++;
+}
+
+/**
+ * Returns in how many ticks the timer wheel has work to do (1 for the next
+ * tick), 0 if no timer is armed. The timers of the upper levels count from
+ * the next cascade, and sleeping tasks from the next time their slot comes,
+ * which is early but safe.
+ **/
+unsigned int nextTimerTicks() {
+    unsigned int ticks = 0;
+    int i;
+
+    for (i = WHEEL_SIZE; i < WHEEL_LEVELS * WHEEL_SIZE; i++){
+        if (timerWheel[i] != -1){
+            ticks = ((WHEEL_SIZE - (kernelTicks & WHEEL_MASK)) & WHEEL_MASK) + 1;
+            break;
+        }
+    }
+    for (i = 0; i < WHEEL_SIZE && (ticks == 0 || (unsigned int) i + 1 < ticks); i++){
+        if (timerWheel[(kernelTicks + i) & WHEEL_MASK] != -1 || taskWheel[(kernelTicks + i) & WHEEL_MASK] != NULL){
+            return i + 1;
+        }
+    }
+    return ticks;
+}
+
+/**
+ * Restores the periodic tick after a tickless idle period and catches up
+ * with the ticks that elapsed, except the one the timer interrupt handles
+ * if onTick is true.
+ **/
+void leaveTickless(bool onTick) {
+    unsigned int ticks = clock_periodic();
+
+    tickless = false;
+    if (onTick && ticks > 0){
+        ticks--;
+    }
+    while (ticks-- > 0){
+        advanceTimers();
+    }
+}
+
+/**
+ * Body of the idle process. It is switched to by dispatch when no process
+ * is ready and leaves through preempt. While it waits, the periodic tick
+ * is replaced by one timer interrupt at the next timer deadline. With
+ * several cores, the tick stays periodic and the idle processes poll the
+ * run queues for work to steal.
+ **/
+void idle() {
+#if KERNEL_CORES == 1
+    unsigned int ticks;
+#endif
+
+    disableInterrupts();
+    while (true){
+        if (highestReady() < PRIORITIES){
+            preempt();
+            continue;
+        }
+#if KERNEL_CORES == 1
+        ticks = nextTimerTicks();
+        if (!tickless && ticks != 1){
+            // no deadline: as long as the timer can count
+            tickless = clock_one_shot(ticks == 0 ? ~0u : ticks);
+        }
+#endif
+        waitForInterrupt();
+    }
+}
+
+/**
+ * Expires the timers of the tick, the processes that time out are only
+ * made ready.
+ **/
+ONCHIP_CODE void expireTick() {
+    if (currentProcess == -1){
+        return;
+    }
+    if (tickless){
+        leaveTickless(true);
+    }
+    advanceTimers();
+}
+
+/**
+ * Called by the timer interrupt handler on every tick: expires the timers,
+ * charges the tick to the running process and switches, from the interrupt
+ * context, to a process that timed out with a better priority or to the
+ * next ready process when the slice is over.
+ **/
+ONCHIP_CODE void timerTick() {
+    ProcessDescriptor *proc;
+
+    if (currentProcess == -1){
+        return;
+    }
+    inInterrupt = true;
+    expireTick();
+    proc = &(PROCESS(currentProcess));
+    if (proc->quantum != 0 && --(proc->sliceLeft) <= 0){
+        if (proc->maskSliceInMonitors && proc->m_sp > 0){
+            // we will give the processor away when leaving the last monitor
+            proc->slicePending = true;
+        }
+        else {
+            endSlice();
+        }
+    }
+    preempt();
+    inInterrupt = false;
+}
+
+/***********************************************************
+ ***********************************************************
+                    Kernel functions
+                    ************************************************************
+                    * **********************************************************/
+
+void endJob();
+unsigned int jobUtilization(unsigned int period, unsigned int wcet);
+
+// first function run by every process, a periodic one runs it once per period
+void processStart()
+{
+    if (PROCESS(currentProcess).period != 0){
+        while (true){
+            PROCESS(currentProcess).entry();
+            endJob();
+        }
+    }
+    PROCESS(currentProcess).entry();
+    processExit();
+}
+
+int createProcessWithPriority (void (*f)(), int stackSize, int priority) {
+    if (priority < 0 || priority >= PRIORITIES){
+        printf("Error: Invalid priority %d!\n", priority);
+        exit(1);
+    }
+
+    int status = disableInterrupts();
+    releaseExitedStack();
+
+    int c = stackClass(stackSize);
+    unsigned int* stack = allocateStack(c, stackSize);
+    if (c < STACK_CLASSES){
+        stackSize = 1 << (c + MIN_STACK_SHIFT);
+    }
+    int id = allocateDescriptor();
+    ProcessDescriptor *proc = &(PROCESS(id));
+
+    proc->next = -1;
+    prepareStack(stack, stackSize);
+    proc->p = newProcess(processStart, stack, stackSize);
+    proc->entry = f;
+    proc->stack = stack;
+    proc->stackSize = stackSize;
+    proc->stackClass = c;
+    proc->core = THIS_CORE;
+    proc->generation = (proc->generation + 1) & GENERATION_MASK;
+    proc->alive = true;
+    initQueue(&(proc->joiners));
+    proc->basePriority = priority;
+    proc->priority = priority;
+    proc->ready = false;
+    proc->blockedOn = -1;
+    proc->quantum = 0;
+    proc->maskSliceInMonitors = false;
+    proc->slicePending = false;
+    proc->m_sp = 0;
+    proc->timerSlot = -1;
+    proc->timedOut = false;
+    proc->waitingOn = NULL;
+    proc->waitMonitor = -1;
+    proc->period = 0;
+    STATS(statsCreated(proc));
+    liveProcesses++;
+
+    // add process to the list of ready Processes
+    makeReady(id);
+
+    preempt();
+    restoreInterrupts(status);
+    return (proc->generation << INDEX_BITS) | id;
+}
+
+int createProcess (void (*f)(), int stackSize) {
+    return createProcessWithPriority(f, stackSize, DEFAULT_PRIORITY);
+}
+
+int getProcessId(){
+    return (PROCESS(currentProcess).generation << INDEX_BITS) | currentProcess;
+}
+
+void processExit(){
+    disableInterrupts();
+    ProcessDescriptor *proc = &(PROCESS(currentProcess));
+
+    if (proc->m_sp != 0){
+        fprintf(stderr, "Error: Process exits inside a monitor\n");
+        exit(1);
+    }
+
+    // wake up the processes joining us
+    while (head(&(proc->joiners)) != -1){
+        makeReady(removeHead(&(proc->joiners)));
+    }
+
+    if (proc->period != 0){
+        utilization -= jobUtilization(proc->period, proc->wcet);
+        periodicCount--;
+    }
+    proc->alive = false;
+    liveProcesses--;
+    if (liveProcesses == 0){
+        printf("All processes have exited.\n");
+        exit(0);
+    }
+
+    // we are still running on our stack, it is released by the next process
+    releaseExitedStack();
+    exitedStack = proc->stack;
+    exitedStackClass = proc->stackClass;
+    addFirst(&freeDescriptors, currentProcess);
+
+    dispatch();
+}
+
+void joinProcess(int processId){
+    int id = processId & (MAX_PROCESSES - 1);
+
+    int status = disableInterrupts();
+    // a recycled descriptor belongs to a newer process, ours has exited
+    if (id < slabCount << SLAB_SHIFT && PROCESS(id).alive &&
+        PROCESS(id).generation == processId >> INDEX_BITS && id != currentProcess){
+        addLast(&(PROCESS(id).joiners), currentProcess);
+        dispatch();
+    }
+    restoreInterrupts(status);
+}
+
+unsigned int kernelHeapUsage(){
+    return heapUsage;
+}
+
+unsigned int kernelSwitches(){
+    return switchCount;
+}
+
+unsigned int kernelSteals(){
+    return stealCount;
+}
+
+#ifdef KERNEL_STACK_CHECK
+int stackHighWater(int processId){
+    int id = processId & (MAX_PROCESSES - 1);
+    int used = -1;
+
+    int status = disableInterrupts();
+    if (id < slabCount << SLAB_SHIFT && PROCESS(id).alive &&
+        PROCESS(id).generation == processId >> INDEX_BITS){
+        // the deepest word that lost the paint, the canary excluded
+        unsigned int* stack = PROCESS(id).stack;
+        int words = PROCESS(id).stackSize / sizeof(unsigned int);
+        int i = 1;
+        while (i < words && stack[i] == STACK_PAINT){
+            i++;
+        }
+        used = (words - i) * sizeof(unsigned int);
+    }
+    restoreInterrupts(status);
+    return used;
+}
+#endif
+
+
+ONCHIP_CODE void yield(){
+    int status = disableInterrupts();
+    // only give the processor to processes with at least our priority
+    if (readyBeats(currentProcess, true)){
+        makeReady(currentProcess);
+        dispatch();
+    }
+    restoreInterrupts(status);
+}
+
+void sleepTicks(int ticks){
+    if (ticks <= 0){
+        return;
+    }
+    int status = disableInterrupts();
+    armTimeout(ticks, NULL, -1);
+    dispatch();
+    endTimeout();
+    restoreInterrupts(status);
+}
+
+unsigned int getTicks(){
+    return kernelTicks;
+}
+
+void setQuantum(int ticks, bool maskInMonitors){
+    int status = disableInterrupts();
+    PROCESS(currentProcess).quantum = ticks > 0 ? ticks : 0;
+    PROCESS(currentProcess).sliceLeft = PROCESS(currentProcess).quantum;
+    PROCESS(currentProcess).maskSliceInMonitors = maskInMonitors;
+    restoreInterrupts(status);
+}
+
+/**
+ * Periodic processes
+ *
+ * A periodic process is released every period ticks by the timer wheel,
+ * its job must be done by the next release. Ready periodic processes are
+ * in the deadline heap instead of a run queue and run before all the
+ * others, the earliest deadline first.
+ **/
+
+// share of the processor a job of wcet ticks every period ticks takes, rounded up
+unsigned int jobUtilization(unsigned int period, unsigned int wcet) {
+    return ((unsigned long long) wcet * UTILIZATION_SCALE + period - 1) / period;
+}
+
+/**
+ * Called when a job is done: counts a miss if its deadline has passed and
+ * waits for the next release. Releases whose deadline is already over are
+ * skipped and counted as misses too.
+ **/
+void endJob() {
+    int status = disableInterrupts();
+    ProcessDescriptor *proc = &(PROCESS(currentProcess));
+
+    // the tick of the deadline is the one of the next release
+    if ((int) (kernelTicks - proc->deadline) >= 0){
+        proc->misses++;
+    }
+    proc->release += proc->period;
+    while ((int) (kernelTicks - (proc->release + proc->period)) >= 0){
+        proc->release += proc->period;
+        proc->misses++;
+    }
+    proc->deadline = proc->release + proc->period;
+    if ((int) (proc->release - kernelTicks) > 0){
+        // woken up by the timer wheel while handling the tick before the release
+        proc->timedOut = false;
+        proc->waitingOn = NULL;
+        proc->waitMonitor = -1;
+        proc->timerExpiry = proc->release - 1;
+        addTimer(currentProcess);
+        dispatch();
+        cancelTimer(currentProcess);
+    }
+    restoreInterrupts(status);
+}
+
+int createPeriodicProcess(void (*f)(), int stackSize, int period, int wcet) {
+    if (period <= 0 || wcet <= 0 || wcet > period){
+        printf("Error: Invalid period %d or wcet %d!\n", period, wcet);
+        exit(1);
+    }
+
+    int status = disableInterrupts();
+    unsigned int share = jobUtilization(period, wcet);
+    if (periodicCount == MAX_PERIODIC || utilization + share > MAX_UTILIZATION){
+        restoreInterrupts(status);
+        return -1;
+    }
+    periodicCount++;
+    utilization += share;
+
+    // created at the lowest priority, it cannot preempt us before it is periodic
+    int processId = createProcessWithPriority(f, stackSize, PRIORITIES - 1);
+    int id = processId & (MAX_PROCESSES - 1);
+    ProcessDescriptor *proc = &(PROCESS(id));
+    removeReady(id);
+    proc->basePriority = REALTIME_PRIORITY;
+    proc->priority = REALTIME_PRIORITY;
+    proc->period = period;
+    proc->wcet = wcet;
+    proc->release = kernelTicks;
+    proc->deadline = kernelTicks + period;
+    proc->misses = 0;
+    makeReady(id);
+    preempt();
+    restoreInterrupts(status);
+    return processId;
+}
+
+unsigned int deadlineMisses(int processId) {
+    int id = processId & (MAX_PROCESSES - 1);
+    unsigned int misses = 0;
+
+    int status = disableInterrupts();
+    if (id < slabCount << SLAB_SHIFT && PROCESS(id).alive &&
+        PROCESS(id).generation == processId >> INDEX_BITS){
+        misses = PROCESS(id).misses;
+    }
+    restoreInterrupts(status);
+    return misses;
+}
+
+// the idle process of a core is in no ready list, never preempts and is not waited for at exit
+static void createIdle(int core){
+    int id = createProcessWithPriority(idle, IDLE_STACK_SIZE, PRIORITIES - 1) & (MAX_PROCESSES - 1);
+    removeReady(id);
+    PROCESS(id).basePriority = PRIORITIES;
+    PROCESS(id).priority = PRIORITIES;
+    PROCESS(id).core = core;
+    idleProcesses[core] = id;
+    liveProcesses--;
+}
+
+#if KERNEL_CORES > 1
+// first function of the other cores, they run their idle process until there is work to steal
+static void coreStart(){
+    disableInterrupts();
+    dispatch();
+}
+#endif
+
+void start(){
+    int core = 0;
+
+    printf("Starting kernel...\n");
+#ifdef KERNEL_STATIC
+    if (slabs == NULL){
+        setupStatic();
+    }
+    core = 1; // the idle process of core 0 is static
+#endif
+    for (; core < KERNEL_CORES; core++){
+        createIdle(core);
+    }
+    disableInterrupts(); // processes start with interrupts allowed
+    if (highestReady() == PRIORITIES){
+        printf("Error: No process in the ready list!\n");
+        exit(1);
+    }
+#if KERNEL_CORES > 1
+    startCores(KERNEL_CORES, coreStart);
+#endif
+    dispatch();
+}
+
+
+/**
+ * Monitor related kernel functions
+ **/
+
+// false to measure the kernel without priority inheritance
+bool priorityInheritance = true;
+
+// monitors are passed to their next owner Hoare-style
+bool directHandOff = false;
+
+/**
+ * Returns the best priority of the processes queued to enter a monitor,
+ * PRIORITIES if there is none.
+ **/
+int waitersPriority(int monitorId)
+{
+    int best = PRIORITIES;
+    int temp = head(&(monitors[monitorId].readyList));
+    while(temp != -1)
+    {
+        if(PROCESS(temp).priority < best)
+        {
+            best = PROCESS(temp).priority;
+        }
+        temp = PROCESS(temp).next;
+    }
+    return best;
+}
+
+/**
+ * Returns the priority a process must run at: its base priority, raised
+ * to the one of the best process queued on a monitor it owns.
+ **/
+int inheritedPriority(int pid)
+{
+    ProcessDescriptor *p = &(PROCESS(pid));
+    int priority = p->basePriority;
+    int i;
+
+    if(!priorityInheritance)
+    {
+        return priority;
+    }
+    for(i = 0 ; i < p->m_sp ; i++)
+    {
+        int mid = p->monitors[i];
+        if(LOCK_OWNER(monitors[mid].lock) == pid)
+        {
+            // a periodic waiter lends the best priority of the others
+            int waiters = waitersPriority(mid);
+            if(waiters < 0)
+            {
+                waiters = 0;
+            }
+            if(waiters < priority)
+            {
+                priority = waiters;
+            }
+        }
+    }
+    return priority;
+}
+
+/**
+ * Recomputes the effective priority of a process after the monitors it owns
+ * or their queues changed. A change is passed on to the owner of the monitor
+ * the process is queued on, and so on along the chain of nested monitors.
+ **/
+void updatePriority(int pid)
+{
+    while(pid != -1)
+    {
+        int priority = inheritedPriority(pid);
+        if(priority == PROCESS(pid).priority)
+        {
+            return;
+        }
+        changePriority(pid, priority);
+        if(PROCESS(pid).blockedOn == -1)
+        {
+            return;
+        }
+        pid = LOCK_OWNER(monitors[PROCESS(pid).blockedOn].lock);
+    }
+}
+
+/**
+ * Makes the first process queued to enter a locked monitor its owner,
+ * without making it ready. Returns -1 if there is none.
+ **/
+int takeOver(int monitorId)
+{
+    MonitorDescriptor *m = &(monitors[monitorId]);
+    int pid = removeHead(&(m->readyList));
+    if(pid != -1)
+    {
+        int previous = LOCK_OWNER(m->lock);
+        bool contended = head(&(m->readyList)) != -1 || m->taskEntering.head != NULL;
+        m->lock = (pid + 1) | (contended ? CONTENDED : 0);
+        m->depth = 1;
+        STATS(monitorAcquired(m));
+        PROCESS(pid).blockedOn = -1;
+        // the new owner inherits from the remaining waiters, the old one no longer does
+        updatePriority(pid);
+        updatePriority(previous);
+    }
+    return pid;
+}
+
+/**
+ * Makes pid the owner of a free monitor, or else sets CONTENDED so that the
+ * owner hands it over when leaving. Returns true if pid got it. The owner
+ * may leave through the fast path of exitMonitor meanwhile, on another
+ * core, so the lock word only changes by compare and swap.
+ **/
+bool acquireOrContend(MonitorDescriptor *m, int pid)
+{
+    while(true)
+    {
+        unsigned int lock = *(volatile unsigned int*) &(m->lock);
+        if(lock == 0 ? compareAndSwap(&(m->lock), 0, pid + 1)
+                     : compareAndSwap(&(m->lock), lock, lock | CONTENDED))
+        {
+            return lock == 0;
+        }
+    }
+}
+
+/**
+ * In hand-off mode, the new owner of a monitor runs right away unless a
+ * process of better priority is ready.
+ **/
+bool runsNext(int pid)
+{
+    return directHandOff && pid != -1 && PROCESS(pid).priority <= highestReady();
+}
+
+void setPriorityInheritance(bool enabled)
+{
+    priorityInheritance = enabled;
+}
+
+void setMonitorHandOff(bool enabled)
+{
+    int status = disableInterrupts();
+    directHandOff = enabled;
+    restoreInterrupts(status);
+}
+
+/**
+ * Returns true if the pid has entered into the monitor with id mid at
+ * least once
+ **/
+bool hasMonitor(int pid, int mid)
+{
+    int i;
+    for(i = 0 ; i < MAX_MONITORS ; i++)
+    {
+        if(PROCESS(pid).monitors[i] == mid)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns the element on top of the monitor stack of a process without deleting it from the stack.
+ **/
+int peekMonitor(ProcessDescriptor *p)
+{
+    if(p->m_sp == 0)
+    {
+        return -1;
+    }
+    return p->monitors[p->m_sp - 1];
+}
+
+/**
+ * Returns and delete the element on top of a process' monitor's stack.
+ **/
+int popMonitor(ProcessDescriptor *p)
+{
+    if(p->m_sp == -1) //Nothing to pop
+    {
+        return -1;
+    }
+    return p->monitors[--(p->m_sp)];
+}
+
+/**
+ * Add an element on at the top of a process' monitor's stack.
+ **/
+void pushMonitor(ProcessDescriptor *p, int monitorId)
+{
+    if(p->m_sp == MAX_MONITORS)
+    {
+        fprintf(stderr, "Process has too many imbricated monitor calls\n");
+        exit(EXIT_FAILURE);
+    }
+    p->monitors[p->m_sp++] = monitorId;
+}
+
+/**
+ * initialize a new monitor if there isn't aready too many of them.
+ **/
+int createMonitor()
+{
+    int status = disableInterrupts();
+    if(nextMonitorID >= MAX_MONITORS)
+    {
+    	fprintf(stderr, "There is already too many Monitors!\n");
+    	exit(1);
+    }
+
+    initQueue(&(monitors[nextMonitorID].waitingList)); // waiting list is yet empty
+    initQueue(&(monitors[nextMonitorID].readyList)); // ready list is yet empty
+    monitors[nextMonitorID].lock = 0; // there is no process in this monitor yet
+    monitors[nextMonitorID].depth = 0;
+    monitors[nextMonitorID].taskEntering.head = NULL; // no task either
+    monitors[nextMonitorID].taskWaiting.head = NULL;
+#ifdef KERNEL_STATS
+    memset(&(monitors[nextMonitorID].stats), 0, sizeof(MonitorStats));
+#endif
+
+    int monitorId = nextMonitorID++;
+    restoreInterrupts(status);
+    return monitorId;
+}
+
+/**
+ * Tries to enter the given monitor depending if it's locked or not, gives
+ * up after ticks timer ticks. Returns false if we did not enter it.
+ **/
+bool enterMonitorTimeout(int monitorId, int ticks)
+{
+    int self = runningProcess();
+    ProcessDescriptor *proc;
+    MonitorDescriptor *m;
+
+    bool entered = true;
+
+    if(monitorId < 0 || monitorId >= nextMonitorID)
+    {
+    	fprintf(stderr, "Invalid monitorId!\n");
+        return false;
+    }
+
+    proc = &(PROCESS(self));
+    m = &(monitors[monitorId]);
+
+    // fast paths: we already have the lock of this monitor, or nobody has it
+    if(LOCK_OWNER(m->lock) == self)
+    {
+        m->depth++;
+        pushMonitor(proc, monitorId);
+        TRACE(TRACE_MONITOR_ENTER, self, monitorId);
+        return true;
+    }
+    if(compareAndSwap(&(m->lock), 0, self + 1))
+    {
+        m->depth = 1;
+        STATS(monitorAcquired(m));
+        pushMonitor(proc, monitorId);
+        TRACE(TRACE_MONITOR_ENTER, self, monitorId);
+        return true;
+    }
+
+    int status = disableInterrupts();
+    // if it has been released meanwhile, we take it for this process and lock it.
+    if(ticks == 0 ? compareAndSwap(&(m->lock), 0, self + 1) : acquireOrContend(m, self))
+    {
+        m->depth = 1;
+        STATS(monitorAcquired(m));
+        pushMonitor(proc, monitorId);
+        TRACE(TRACE_MONITOR_ENTER, self, monitorId);
+    }
+    else if(ticks == 0) // it's locked somewhere else and we cannot wait
+    {
+        entered = false;
+    }
+    else // it's locked somewhere else
+    {
+        pushMonitor(proc, monitorId);
+        addLast(&(m->readyList), self); // we put the current process in the readyList
+        proc->blockedOn = monitorId;
+        STATS(m->stats.contentions++);
+        TRACE(TRACE_MONITOR_BLOCK, self, monitorId);
+        updatePriority(LOCK_OWNER(m->lock)); // the owner runs at least at our priority
+        armTimeout(ticks, &(m->readyList), -1);
+        dispatch(); // we transfer control to another process.
+        if(endTimeout())
+        {
+            popMonitor(proc);
+            entered = false;
+        }
+        else
+        {
+            TRACE(TRACE_MONITOR_ENTER, self, monitorId);
+        }
+    }
+    restoreInterrupts(status);
+    return entered;
+}
+
+void enterMonitor(int monitorId)
+{
+    enterMonitorTimeout(monitorId, WAIT_FOREVER);
+}
+
+/**
+ * Wait to be notified by a given monitor, at most ticks timer ticks.
+ * Returns false if the timer expired, we are back in the monitor anyway.
+ **/
+bool waitTimeout(int ticks)
+{
+    int status = disableInterrupts();
+    ProcessDescriptor *proc = &(PROCESS(currentProcess));
+    int monitorId = peekMonitor(proc);
+
+    if(monitorId == -1)
+    {
+    	fprintf(stderr, "Error: Process is in no monitors\n");
+        restoreInterrupts(status);
+        return false;
+    }
+
+    // we leave the monitor whatever the number of times we entered it
+    int depth = monitors[monitorId].depth;
+    TRACE(TRACE_MONITOR_WAIT, currentProcess, monitorId);
+    STATS(monitorReleased(&(monitors[monitorId])));
+
+    // if there is no other process ready to run in this monitor, we unlock the monitor
+    if(head(&(monitors[monitorId].readyList)) == -1)
+    {
+        monitors[monitorId].lock = 0;
+        wakeTasks(&(monitors[monitorId].taskEntering));
+        updatePriority(currentProcess);
+    }
+
+    // we add our process to the waiting list of the given monitor
+    addLast(&(monitors[monitorId].waitingList), currentProcess);
+    armTimeout(ticks, &(monitors[monitorId].waitingList), monitorId);
+
+    // we transfer control to another process (and add head of this monitor readylist if there is one)
+    int next = takeOver(monitorId);
+    if(runsNext(next))
+    {
+        switchTo(next);
+    }
+    else
+    {
+        makeReady(next);
+        dispatch();
+    }
+    monitors[monitorId].depth = depth;
+    TRACE(TRACE_MONITOR_ENTER, currentProcess, monitorId);
+    bool notified = !endTimeout();
+    restoreInterrupts(status);
+    return notified;
+}
+
+void wait()
+{
+    waitTimeout(WAIT_FOREVER);
+}
+
+/**
+ * Notify a process from the waitingList of the current monitor
+ **/
+void notify()
+{
+    int status = disableInterrupts();
+    ProcessDescriptor *proc = &(PROCESS(currentProcess));
+    int monitorId = peekMonitor(proc);
+
+    if(monitorId == -1)
+    {
+    	fprintf(stderr, "Error: Process is in no monitors\n");
+        restoreInterrupts(status);
+        return;
+    }
+
+    // we transfer the head of its waitingList to its readyList.
+    int pid = removeHead(&(monitors[monitorId].waitingList));
+    if(pid != -1)
+    {
+        addLast(&(monitors[monitorId].readyList), pid);
+        PROCESS(pid).blockedOn = monitorId;
+        monitors[monitorId].lock |= CONTENDED;
+    }
+    // else a task in TASK_WAIT, it enters the monitor again once we leave it
+    else if(monitors[monitorId].taskWaiting.head != NULL)
+    {
+        Task* task = monitors[monitorId].taskWaiting.head;
+        monitors[monitorId].taskWaiting.head = task->next;
+        appendTask(&(monitors[monitorId].taskEntering), task);
+        monitors[monitorId].lock |= CONTENDED;
+    }
+    updatePriority(currentProcess);
+    restoreInterrupts(status);
+}
+
+/**
+ * Notify all processes waiting on the current monitor
+ **/
+void notifyAll()
+{
+    int status = disableInterrupts();
+    ProcessDescriptor *proc = &(PROCESS(currentProcess));
+    int monitorId = peekMonitor(proc);
+
+    if(monitorId == -1)
+    {
+    	fprintf(stderr, "Error: Process is in no monitors\n");
+        restoreInterrupts(status);
+        return;
+    }
+
+    // we put every process of the waitingList in the readyList of the current monitor.
+    if(head(&(monitors[monitorId].waitingList)) != -1)
+    {
+        int pid;
+        for(pid = head(&(monitors[monitorId].waitingList)); pid != -1; pid = PROCESS(pid).next)
+        {
+            PROCESS(pid).blockedOn = monitorId;
+        }
+        addAll(&(monitors[monitorId].readyList), &(monitors[monitorId].waitingList));
+        monitors[monitorId].lock |= CONTENDED;
+    }
+    if(monitors[monitorId].taskWaiting.head != NULL)
+    {
+        addAllTasks(&(monitors[monitorId].taskEntering), &(monitors[monitorId].taskWaiting));
+        monitors[monitorId].lock |= CONTENDED;
+    }
+    updatePriority(currentProcess);
+    restoreInterrupts(status);
+}
+
+/**
+ * Leaves the current monitor section
+ **/
+void exitMonitor()
+{
+    int self = runningProcess();
+    ProcessDescriptor *proc = &(PROCESS(self));
+    int monitorId = peekMonitor(proc);
+
+    if(monitorId == -1)
+    {
+    	fprintf(stderr, "Error: Process is in no monitors\n");
+        return;
+    }
+    MonitorDescriptor *m = &(monitors[monitorId]);
+    TRACE(TRACE_MONITOR_EXIT, self, monitorId);
+
+    // fast paths: we entered this monitor more than once, or nobody queued on it
+    if(m->depth > 1)
+    {
+        m->depth--;
+        popMonitor(proc);
+        return;
+    }
+    // the hold time ends before anybody can take the monitor
+    STATS(monitorReleased(m));
+    if(!proc->slicePending && compareAndSwap(&(m->lock), self + 1, 0))
+    {
+        popMonitor(proc);
+        return;
+    }
+
+    int status = disableInterrupts();
+    popMonitor(proc);
+
+    // If there is no more ready process for the current monitor
+    if(head(&(m->readyList)) == -1)
+    {
+        m->lock = 0; // We unlock.
+        wakeTasks(&(m->taskEntering)); // the tasks that found it locked try again
+        updatePriority(self);
+    }
+    // If there is still ready process, we put the head of the monitor's readyList in the kernel readyList and we do not unlock the monitor
+    else
+    {
+        int next = takeOver(monitorId);
+        if(runsNext(next) && PROCESS(next).priority <= proc->priority)
+        {
+            // we resume as soon as the new owner gives the processor away
+            makeReadyFirst(self);
+            switchTo(next);
+        }
+        else
+        {
+            makeReady(next);
+        }
+    }
+    // a process we made ready, or one we were holding back, may beat us now
+    preempt();
+
+    // the time slice ended while we were in a monitor
+    if(proc->slicePending && proc->m_sp == 0)
+    {
+        endSlice();
+    }
+    restoreInterrupts(status);
+}
+
+/**
+ * Event related kernel functions
+ **/
+
+// list of event descriptors
+#ifdef KERNEL_STATIC
+#define STATIC_EVENT(name, mode) [name] = { EMPTY_QUEUE, false, mode },
+ONCHIP_DATA EventDescriptor events[MAX_EVENTS] = { KERNEL_EVENTS(STATIC_EVENT) };
+int nextEventID = STATIC_EVENTS;
+_Static_assert(STATIC_EVENTS <= MAX_EVENTS, "too many events in kernelConfig.h");
+#else
+ONCHIP_DATA EventDescriptor events[MAX_EVENTS];
+int nextEventID = 0;
+#endif
+
+/**
+ * We create a new event if we haven't reached the max amount of them
+ **/
+int createEventWithMode(int mode)
+{
+    if(mode != EVENT_MANUAL_RESET && mode != EVENT_AUTO_RESET && mode != EVENT_PULSE)
+    {
+        printf("Error: invalid event mode %d\n", mode);
+        exit(1);
+    }
+    int status = disableInterrupts();
+    // We check if we haven't reached the max amount of events yet
+    if(nextEventID == MAX_EVENTS)
+    {
+        printf("Error: No more events available\n");
+        exit(1);
+    }
+    initQueue(&(events[nextEventID].waitingList)); // no process are waiting yet
+    events[nextEventID].happened = false; // event hasn't happened yet
+    events[nextEventID].mode = mode;
+    events[nextEventID].taskWaiting.head = NULL;
+#ifdef KERNEL_STATS
+    memset(&(events[nextEventID].stats), 0, sizeof(EventStats));
+#endif
+
+    int eventID = nextEventID++;
+    restoreInterrupts(status);
+    return eventID; // return the ID of the newly created event
+}
+
+int createEvent()
+{
+    return createEventWithMode(EVENT_MANUAL_RESET);
+}
+
+/**
+ * We put the current process in the waitingList of the current event, for
+ * at most ticks timer ticks. Returns false if the event did not happen.
+ **/
+bool attendreTimeout(int eventID, int ticks)
+{
+    bool happened = true;
+
+    if(eventID < 0 || eventID >= nextEventID)
+    {
+        printf("Error: using invalid event!!\n");
+        return false;
+    }
+
+    int status = disableInterrupts();
+    if(events[eventID].happened && events[eventID].mode == EVENT_AUTO_RESET)
+    {
+        events[eventID].happened = false; // we consume it
+    }
+    else if(!events[eventID].happened && ticks == 0)
+    {
+        happened = false;
+    }
+    else if(!events[eventID].happened)
+    {
+        STATS(events[eventID].stats.waits++);
+        addLast(&(events[eventID].waitingList), currentProcess);
+        armTimeout(ticks, &(events[eventID].waitingList), -1);
+        dispatch();
+        happened = !endTimeout();
+    }
+    restoreInterrupts(status);
+    return happened;
+}
+
+void attendre(int eventID)
+{
+    attendreTimeout(eventID, WAIT_FOREVER);
+}
+
+/**
+ * Take all processes of the waitingList out of it and put them in the kernel readyList,
+ * the processor goes to the best of them if it beats the running process.
+ * An auto-reset event only wakes the head of the waitingList, or stays set
+ * for the next attendre if nobody waits; a pulse wakes the waiting processes
+ * without staying set. Waiting tasks come after the processes.
+ **/
+void declencher(int eventID)
+{
+    if(eventID < 0 || eventID >= nextEventID)
+    {
+        printf("Error: using invalid event!!\n");
+        return;
+    }
+
+    int status = disableInterrupts();
+    TRACE(TRACE_EVENT_FIRE, currentProcess, eventID);
+    STATS(events[eventID].stats.fires++);
+    if(events[eventID].mode == EVENT_AUTO_RESET)
+    {
+        int waiter = removeHead(&(events[eventID].waitingList));
+        Task* task = events[eventID].taskWaiting.head;
+        if(waiter != -1)
+        {
+            makeReady(waiter);
+        }
+        else if(task != NULL)
+        {
+            events[eventID].taskWaiting.head = task->next;
+            wakeTask(task);
+        }
+        else
+        {
+            events[eventID].happened = true;
+        }
+    }
+    else
+    {
+        if(events[eventID].mode == EVENT_MANUAL_RESET)
+        {
+            events[eventID].happened = true; // YES IT HAS HAPPENED! Don't forget to state it or it will deadlock
+        }
+        while(head(&(events[eventID].waitingList)) != -1)
+        {
+            makeReady(removeHead(&(events[eventID].waitingList)));
+        }
+        wakeTasks(&(events[eventID].taskWaiting));
+    }
+    preempt();
+    restoreInterrupts(status);
+}
+
+/**
+ * We turn the given event back to untriggered.
+ **/
+void reinitialiser(int eventID)
+{
+    if(eventID < 0 || eventID >= nextEventID)
+    {
+        printf("Error: using invalid event!!\n");
+        return;
+    }
+
+    events[eventID].happened = false;
+}
+
+/**
+ * Task related kernel functions
+ *
+ * The runner of a priority is a process that resumes its ready tasks one
+ * after the other, and blocks in no list when there is none left, until
+ * wakeTask makes it ready again. A task that blocks is put in the task
+ * list of the event or monitor, or in the task wheel, and its function
+ * returns to the runner: blocking costs neither a switch nor a stack. A
+ * task that yields is kept by the runner for its next pass, without
+ * disabling the interrupts.
+ **/
+
+static void runTasks()
+{
+    TaskRunner *r = &(runners[PROCESS(currentProcess).basePriority]);
+    ProcessDescriptor *proc = &(PROCESS(currentProcess));
+    TaskQueue yielded = { NULL, NULL };
+
+    int status = disableInterrupts();
+    while(true)
+    {
+        // processes of our priority get their turn between two passes
+        if(readyBeats(currentProcess, true))
+        {
+            makeReady(currentProcess);
+            dispatch();
+        }
+        // the tasks that yielded go after the ones woken up meanwhile
+        addAllTasks(&(r->ready), &yielded);
+        Task* task = takeTasks(&(r->ready));
+        if(task == NULL)
+        {
+            r->blocked = true;
+            dispatch();
+            continue;
+        }
+        restoreInterrupts(status);
+
+        while(task != NULL)
+        {
+            Task* next = task->next;
+            if(task->run(task) == TASK_YIELDED)
+            {
+                appendTask(&yielded, task);
+            }
+            if(proc->m_sp != 0)
+            {
+                fprintf(stderr, "Error: Task blocks inside a monitor\n");
+                exit(1);
+            }
+            task = next;
+        }
+        status = disableInterrupts();
+    }
+}
+
+void createTaskWithPriority(Task* task, int (*run)(Task*), int priority)
+{
+    if(priority < 0 || priority >= PRIORITIES)
+    {
+        printf("Error: Invalid priority %d!\n", priority);
+        exit(1);
+    }
+    task->run = run;
+    task->line = 0;
+    task->priority = priority;
+
+    int status = disableInterrupts();
+    TaskRunner *r = &(runners[priority]);
+    if(r->process == -1)
+    {
+        // like the idle processes, it is not waited for at exit
+        r->process = createProcessWithPriority(runTasks, IDLE_STACK_SIZE, priority) & (MAX_PROCESSES - 1);
+        liveProcesses--;
+    }
+    wakeTask(task);
+    preempt();
+    restoreInterrupts(status);
+}
+
+void createTask(Task* task, int (*run)(Task*))
+{
+    createTaskWithPriority(task, run, DEFAULT_PRIORITY);
+}
+
+bool taskAttendre(Task* task, int eventID)
+{
+    bool happened = true;
+
+    if(eventID < 0 || eventID >= nextEventID)
+    {
+        printf("Error: using invalid event!!\n");
+        return true;
+    }
+
+    int status = disableInterrupts();
+    if(events[eventID].happened && events[eventID].mode == EVENT_AUTO_RESET)
+    {
+        events[eventID].happened = false; // we consume it
+    }
+    else if(!events[eventID].happened)
+    {
+        STATS(events[eventID].stats.waits++);
+        appendTask(&(events[eventID].taskWaiting), task);
+        happened = false;
+    }
+    restoreInterrupts(status);
+    return happened;
+}
+
+bool taskSleep(Task* task, int ticks)
+{
+    if(ticks <= 0)
+    {
+        return true;
+    }
+
+    int status = disableInterrupts();
+    // the tick being counted is the first one, as for armTimeout
+    task->timerExpiry = kernelTicks + ticks - 1;
+    task->next = taskWheel[task->timerExpiry & WHEEL_MASK];
+    taskWheel[task->timerExpiry & WHEEL_MASK] = task;
+    restoreInterrupts(status);
+    return false;
+}
+
+/**
+ * Enters a monitor for the runner, or queues the task to try again once it
+ * is free. The task does not hold its place: whoever comes first gets it.
+ **/
+bool taskEnter(Task* task, int monitorId)
+{
+    bool entered = true;
+
+    if(monitorId < 0 || monitorId >= nextMonitorID)
+    {
+        fprintf(stderr, "Invalid monitorId!\n");
+        return true;
+    }
+    if(enterMonitorTimeout(monitorId, 0))
+    {
+        return true;
+    }
+
+    int status = disableInterrupts();
+    MonitorDescriptor *m = &(monitors[monitorId]);
+    if(acquireOrContend(m, currentProcess))
+    {
+        m->depth = 1;
+        STATS(monitorAcquired(m));
+        pushMonitor(&(PROCESS(currentProcess)), monitorId);
+        TRACE(TRACE_MONITOR_ENTER, currentProcess, monitorId);
+    }
+    else
+    {
+        STATS(m->stats.contentions++);
+        appendTask(&(m->taskEntering), task);
+        entered = false;
+    }
+    restoreInterrupts(status);
+    return entered;
+}
+
+/**
+ * Leaves the monitor of the task, which waits to be notified, as in
+ * waitTimeout but without giving the processor away.
+ **/
+void taskWait(Task* task)
+{
+    int status = disableInterrupts();
+    ProcessDescriptor *proc = &(PROCESS(currentProcess));
+    int monitorId = peekMonitor(proc);
+    MonitorDescriptor *m;
+
+    if(monitorId == -1)
+    {
+        fprintf(stderr, "Error: Task is in no monitors\n");
+        exit(1);
+    }
+    popMonitor(proc);
+    m = &(monitors[monitorId]);
+    TRACE(TRACE_MONITOR_WAIT, currentProcess, monitorId);
+    STATS(monitorReleased(m));
+    task->monitor = monitorId;
+    appendTask(&(m->taskWaiting), task);
+
+    if(head(&(m->readyList)) == -1)
+    {
+        m->lock = 0;
+        wakeTasks(&(m->taskEntering));
+        updatePriority(currentProcess);
+    }
+    else
+    {
+        makeReady(takeOver(monitorId));
+    }
+    preempt();
+    restoreInterrupts(status);
+}
+
+/**
+ * Channel related kernel functions
+ *
+ * The ring is the bounded queue of D. Vyukov: each cell has a sequence
+ * number telling the lap it is free or full for, so senders and receivers
+ * only race on their own position. trySend and tryRecv never disable
+ * interrupts (except for the compare and swap on the Nios, which has no
+ * atomic instruction) and only enter the kernel to wake a blocked process.
+ **/
+
+// list of channel descriptors
+#ifdef KERNEL_STATIC
+// the rings, whose sequence numbers are set by start()
+#define STATIC_RING(name, capacity, single) ChannelCell staticRing_##name[capacity]; \
+    _Static_assert(((capacity) & ((capacity) - 1)) == 0, "capacity of " #name " is not a power of two");
+KERNEL_CHANNELS(STATIC_RING)
+#define STATIC_CHANNEL(name, capacity, single) [name] = { staticRing_##name, (capacity) - 1, single, 0, 0, EMPTY_QUEUE, EMPTY_QUEUE },
+ChannelDescriptor channels[MAX_CHANNELS] = { KERNEL_CHANNELS(STATIC_CHANNEL) };
+int nextChannelID = STATIC_CHANNELS;
+_Static_assert(STATIC_CHANNELS <= MAX_CHANNELS, "too many channels in kernelConfig.h");
+#else
+ChannelDescriptor channels[MAX_CHANNELS];
+int nextChannelID = 0;
+#endif
+
+/**
+ * Claims the cell at *position if its sequence is position + offset, that
+ * is if it is free (offset 0) or full (offset 1) for this lap. Returns NULL
+ * if the ring is full or empty.
+ **/
+static ChannelCell* claimCell(ChannelDescriptor* ch, unsigned int* position, unsigned int offset, bool single)
+{
+    unsigned int pos = __atomic_load_n(position, __ATOMIC_RELAXED);
+    while(true)
+    {
+        ChannelCell* cell = &(ch->cells[pos & ch->mask]);
+        int diff = (int) (__atomic_load_n(&(cell->sequence), __ATOMIC_ACQUIRE) - (pos + offset));
+        if(diff < 0)
+        {
+            return NULL;
+        }
+        if(diff == 0)
+        {
+            if(single)
+            {
+                __atomic_store_n(position, pos + 1, __ATOMIC_RELAXED);
+                return cell;
+            }
+            if(compareAndSwap(position, pos, pos + 1))
+            {
+                return cell;
+            }
+        }
+        // another sender or receiver took the cell first
+        pos = __atomic_load_n(position, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Makes the first process of a channel queue ready. From an ISR the switch
+ * to a better process saves the full frame.
+ **/
+static void wakeChannel(Queue* waiters, bool fromInterrupt)
+{
+    // checking without the lock is enough, see channelWait
+#if KERNEL_CORES > 1
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+    if(head(waiters) == -1)
+    {
+        return;
+    }
+    int status = disableInterrupts();
+    makeReady(removeHead(waiters));
+    inInterrupt = fromInterrupt;
+    preempt();
+    inInterrupt = false;
+    restoreInterrupts(status);
+}
+
+static bool validChannel(int channelID)
+{
+    if(channelID < 0 || channelID >= nextChannelID)
+    {
+        fprintf(stderr, "Error: using invalid channel!!\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Creates a channel holding up to capacity messages, rounded up to a power
+ * of two. If single is true, there must be at most one sending and one
+ * receiving process (or ISR) at a time.
+ **/
+int createChannel(int capacity, bool single)
+{
+    unsigned int size = 1;
+    unsigned int i;
+
+    while(size < (unsigned int) capacity)
+    {
+        size <<= 1;
+    }
+
+    int status = disableInterrupts();
+    if(nextChannelID == MAX_CHANNELS)
+    {
+        printf("Error: No more channels available\n");
+        exit(1);
+    }
+    ChannelDescriptor* ch = &(channels[nextChannelID]);
+    ch->cells = malloc(size * sizeof(ChannelCell));
+    if(ch->cells == NULL)
+    {
+        printf("Error: Not enough memory for the channel\n");
+        exit(1);
+    }
+    heapUsage += size * sizeof(ChannelCell);
+    for(i = 0 ; i < size ; i++)
+    {
+        ch->cells[i].sequence = i;
+    }
+    ch->mask = size - 1;
+    ch->single = single;
+    ch->sendPosition = 0;
+    ch->recvPosition = 0;
+    initQueue(&(ch->senders));
+    initQueue(&(ch->receivers));
+
+    int channelID = nextChannelID++;
+    restoreInterrupts(status);
+    return channelID;
+}
+
+static bool sendMessage(int channelID, int message, bool fromInterrupt)
+{
+    ChannelDescriptor* ch = &(channels[channelID]);
+    ChannelCell* cell = claimCell(ch, &(ch->sendPosition), 0, ch->single);
+    if(cell == NULL)
+    {
+        return false;
+    }
+    cell->message = message;
+    // publishes the message for the receivers of this lap
+    __atomic_store_n(&(cell->sequence), cell->sequence + 1, __ATOMIC_RELEASE);
+    wakeChannel(&(ch->receivers), fromInterrupt);
+    return true;
+}
+
+/**
+ * Puts a message in the channel, returns false if it is full.
+ **/
+bool trySend(int channelID, int message)
+{
+    return validChannel(channelID) && sendMessage(channelID, message, false);
+}
+
+/**
+ * Same as trySend, to be called from an interrupt routine.
+ **/
+bool isrSend(int channelID, int message)
+{
+    return validChannel(channelID) && sendMessage(channelID, message, true);
+}
+
+/**
+ * Takes a message out of the channel, returns false if it is empty.
+ **/
+bool tryRecv(int channelID, int* message)
+{
+    if(!validChannel(channelID))
+    {
+        return false;
+    }
+    ChannelDescriptor* ch = &(channels[channelID]);
+    ChannelCell* cell = claimCell(ch, &(ch->recvPosition), 1, ch->single);
+    if(cell == NULL)
+    {
+        return false;
+    }
+    *message = cell->message;
+    // frees the cell for the senders of the next lap
+    __atomic_store_n(&(cell->sequence), cell->sequence + ch->mask, __ATOMIC_RELEASE);
+    wakeChannel(&(ch->senders), false);
+    return true;
 }
 
 /**
- * We put the current process in the waitingList of the current event
+ * Blocks the running process on a channel queue unless the cell at
+ * position became available (sequence position + offset) meanwhile. We
+ * queue before looking at the cell: a sender or receiver that completes
+ * after that, on another core or in an ISR, sees us in the queue.
  **/
-void attendre(int eventID)
+static void channelWait(ChannelDescriptor* ch, Queue* waiters, unsigned int* position, unsigned int offset)
 {
-    if(eventID < 0 || eventID >= nextEventID)
+    int status = disableInterrupts();
+    addLast(waiters, currentProcess);
+#if KERNEL_CORES > 1
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // pairs with the one of wakeChannel
+#endif
+    unsigned int pos = __atomic_load_n(position, __ATOMIC_RELAXED);
+    int diff = (int) (__atomic_load_n(&(ch->cells[pos & ch->mask].sequence), __ATOMIC_ACQUIRE) - (pos + offset));
+    if(diff < 0)
+    {
+        dispatch();
+    }
+    else
+    {
+        removeFromList(waiters, currentProcess);
+    }
+    restoreInterrupts(status);
+}
+
+/**
+ * Puts a message in the channel, waiting for room if it is full.
+ **/
+void channelSend(int channelID, int message)
+{
+    if(!validChannel(channelID))
     {
-        printf("Error: using invalid event!!\n");
         return;
     }
+    ChannelDescriptor* ch = &(channels[channelID]);
+    while(!sendMessage(channelID, message, false))
+    {
+        channelWait(ch, &(ch->senders), &(ch->sendPosition), 0);
+    }
+}
 
-    if(!events[eventID].happened)
+/**
+ * Takes a message out of the channel, waiting for one if it is empty.
+ **/
+int channelRecv(int channelID)
+{
+    int message = 0;
+
+    if(!validChannel(channelID))
     {
-        addLast(&(events[eventID].waitingList), removeHead(&readyList));
-        transfer(processes[head(&readyList)].p);
+        return 0;
     }
+    ChannelDescriptor* ch = &(channels[channelID]);
+    while(!tryRecv(channelID, &message))
+    {
+        channelWait(ch, &(ch->receivers), &(ch->recvPosition), 1);
+    }
+    return message;
 }
 
 /**
- * Take all processes of the waitingList out of it and put them in the kernel readyList
+ * Deferred interrupt work
+ *
+ * The interrupt routines are the only writers of the tail of their ring,
+ * the kernel takes the records with interrupts disabled. The deferred work
+ * process is only woken up when a record arrives for a vector a process is
+ * blocked on; it hands out the records of all the vectors before giving
+ * the processor to the best of the processes it woke up, so that a burst
+ * costs a single pass.
  **/
-void declencher(int eventID)
+
+ONCHIP_DATA InterruptRing interruptRings[MAX_VECTORS] = { [0 ... MAX_VECTORS - 1] = { .waiters = EMPTY_QUEUE } };
+
+// process that hands the records out, created by the first waitInterrupt
+int deferredProcess = -1;
+
+// the deferred work process is ready or running, the routines need not wake it up
+bool deferredPending = false;
+
+static bool takeInterrupt(InterruptRing* ring, InterruptRecord* record)
 {
-    if(eventID < 0 || eventID >= nextEventID)
+    unsigned int first = ring->head;
+
+    if(first == __atomic_load_n(&(ring->tail), __ATOMIC_ACQUIRE))
     {
-        printf("Error: using invalid event!!\n");
+        return false;
+    }
+    *record = ring->records[first & (INTERRUPT_RING_SIZE - 1)];
+    __atomic_store_n(&(ring->head), first + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * Body of the deferred work process: it gives each waiting process its
+ * record and blocks, in no list, until postInterrupt makes it ready again.
+ * Cleared before the pass, deferredPending lets a record posted meanwhile
+ * from another core wake it up once more.
+ **/
+static void deferredWork()
+{
+    int vector;
+
+    disableInterrupts();
+    while(true)
+    {
+        deferredPending = false;
+        for(vector = 0; vector < MAX_VECTORS; vector++)
+        {
+            InterruptRing* ring = &(interruptRings[vector]);
+            int pid;
+
+            while((pid = head(&(ring->waiters))) != -1 && takeInterrupt(ring, PROCESS(pid).interruptRecord))
+            {
+                makeReady(removeHead(&(ring->waiters)));
+            }
+        }
+        dispatch();
+    }
+}
+
+/**
+ * Queues a record on the ring of vector. Called from an interrupt routine:
+ * the switch to the deferred work process saves the full frame. Unless
+ * switching is true, the deferred work process is only made ready.
+ **/
+ONCHIP_CODE static int queueInterrupt(int vector, unsigned int bits, bool switching)
+{
+    if(vector < 0 || vector >= MAX_VECTORS || !interruptRings[vector].armed)
+    {
+        return INTERRUPT_UNARMED;
+    }
+    InterruptRing* ring = &(interruptRings[vector]);
+    unsigned int last = ring->tail;
+    if(last - __atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE) == INTERRUPT_RING_SIZE)
+    {
+        ring->lost++;
+        return INTERRUPT_LOST;
+    }
+    InterruptRecord* record = &(ring->records[last & (INTERRUPT_RING_SIZE - 1)]);
+    record->vector = vector;
+    record->bits = bits;
+    record->time = read_timestamp();
+    __atomic_store_n(&(ring->tail), last + 1, __ATOMIC_RELEASE);
+
+    int status = disableInterrupts();
+    if(!deferredPending && head(&(ring->waiters)) != -1)
+    {
+        deferredPending = true;
+        makeReady(deferredProcess);
+        if(switching)
+        {
+            inInterrupt = true;
+            preempt();
+            inInterrupt = false;
+        }
+    }
+    restoreInterrupts(status);
+    return INTERRUPT_POSTED;
+}
+
+ONCHIP_CODE int postInterrupt(int vector, unsigned int bits)
+{
+    return queueInterrupt(vector, bits, true);
+}
+
+ONCHIP_CODE int postInterruptLater(int vector, unsigned int bits)
+{
+    return queueInterrupt(vector, bits, false);
+}
+
+/**
+ * Takes the next record of vector, waiting for the deferred work to hand
+ * one out if the ring is empty or other processes wait before us.
+ **/
+void waitInterrupt(int vector, InterruptRecord* record)
+{
+    if(vector < 0 || vector >= MAX_VECTORS)
+    {
+        printf("Error: using invalid interrupt vector!!\n");
         return;
     }
 
-    events[eventID].happened = true; // YES IT HAS HAPPENED! Don't forget to state it or it will deadlock
+    int status = disableInterrupts();
+    InterruptRing* ring = &(interruptRings[vector]);
+    if(deferredProcess == -1)
+    {
+        // like the idle processes, it is not waited for at exit
+        deferredPending = true;
+        deferredProcess = createProcessWithPriority(deferredWork, IDLE_STACK_SIZE, 0) & (MAX_PROCESSES - 1);
+        liveProcesses--;
+    }
+    ring->armed = true;
+    if(head(&(ring->waiters)) != -1 || !takeInterrupt(ring, record))
+    {
+        PROCESS(currentProcess).interruptRecord = record;
+        addLast(&(ring->waiters), currentProcess);
+        dispatch();
+    }
+    restoreInterrupts(status);
+}
+
+unsigned int lostInterrupts(int vector)
+{
+    return vector >= 0 && vector < MAX_VECTORS ? interruptRings[vector].lost : 0;
+}
+
+/**
+ * Semaphore related kernel functions
+ **/
 
-    while(head(&(events[eventID].waitingList)) != -1)
+// list of semaphore descriptors
+SemaphoreDescriptor semaphores[MAX_SEMAPHORES];
+int nextSemaphoreID = 0;
+
+/**
+ * Creates a counting semaphore holding count units.
+ **/
+int createSemaphore(int count)
+{
+    int status = disableInterrupts();
+    if(nextSemaphoreID == MAX_SEMAPHORES)
     {
-        addLast(&readyList, removeHead(&(events[eventID].waitingList)));
+        printf("Error: No more semaphores available\n");
+        exit(1);
     }
+    initQueue(&(semaphores[nextSemaphoreID].waitingList));
+    semaphores[nextSemaphoreID].count = count;
+
+    int semaphoreID = nextSemaphoreID++;
+    restoreInterrupts(status);
+    return semaphoreID;
 }
 
 /**
- * We turn the given event back to untriggered.
+ * Takes a unit of the semaphore, waiting for one to be released if there
+ * is none.
  **/
-void reinitialiser(int eventID)
+void semaphoreWait(int semaphoreID)
 {
-    if(eventID < 0 || eventID >= nextEventID)
+    if(semaphoreID < 0 || semaphoreID >= nextSemaphoreID)
     {
-        printf("Error: using invalid event!!\n");
+        printf("Error: using invalid semaphore!!\n");
         return;
     }
 
-    events[eventID].happened = false;
+    int status = disableInterrupts();
+    if(semaphores[semaphoreID].count > 0)
+    {
+        semaphores[semaphoreID].count--;
+    }
+    else
+    {
+        // semaphoreSignal gives us its unit directly
+        addLast(&(semaphores[semaphoreID].waitingList), currentProcess);
+        dispatch();
+    }
+    restoreInterrupts(status);
+}
+
+/**
+ * Releases a unit of the semaphore, to the first waiting process if any.
+ **/
+void semaphoreSignal(int semaphoreID)
+{
+    if(semaphoreID < 0 || semaphoreID >= nextSemaphoreID)
+    {
+        printf("Error: using invalid semaphore!!\n");
+        return;
+    }
+
+    int status = disableInterrupts();
+    int pid = removeHead(&(semaphores[semaphoreID].waitingList));
+    if(pid == -1)
+    {
+        semaphores[semaphoreID].count++;
+    }
+    else
+    {
+        makeReady(pid);
+        preempt();
+    }
+    restoreInterrupts(status);
+}
+
+/**
+ * Reader-writer lock related kernel functions
+ *
+ * The lock is passed directly to the processes it wakes up: they do not
+ * compete again for it when they run.
+ **/
+
+// list of reader-writer lock descriptors
+RWLockDescriptor rwLocks[MAX_RWLOCKS];
+int nextRWLockID = 0;
+
+int createRWLock(bool writerPreference)
+{
+    int status = disableInterrupts();
+    if(nextRWLockID == MAX_RWLOCKS)
+    {
+        printf("Error: No more reader-writer locks available\n");
+        exit(1);
+    }
+    RWLockDescriptor *l = &(rwLocks[nextRWLockID]);
+    initQueue(&(l->readersWaiting));
+    initQueue(&(l->writersWaiting));
+    l->readers = 0;
+    l->writer = -1;
+    l->writerPreference = writerPreference;
+
+    int lockID = nextRWLockID++;
+    restoreInterrupts(status);
+    return lockID;
+}
+
+static bool validRWLock(int lockID)
+{
+    if(lockID < 0 || lockID >= nextRWLockID)
+    {
+        printf("Error: using invalid reader-writer lock!!\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Gives the lock to the next writer or to all the waiting readers, the
+ * writers first if they have the preference. The lock must be free.
+ **/
+static void passRWLock(RWLockDescriptor *l)
+{
+    bool readersFirst = !l->writerPreference || head(&(l->writersWaiting)) == -1;
+
+    if(readersFirst && head(&(l->readersWaiting)) != -1)
+    {
+        while(head(&(l->readersWaiting)) != -1)
+        {
+            l->readers++;
+            makeReady(removeHead(&(l->readersWaiting)));
+        }
+    }
+    else if(head(&(l->writersWaiting)) != -1)
+    {
+        l->writer = removeHead(&(l->writersWaiting));
+        makeReady(l->writer);
+    }
+    preempt();
+}
+
+/**
+ * Takes the lock for reading, along with the other readers. With the
+ * writer preference, we also wait if a writer is waiting.
+ **/
+void readLock(int lockID)
+{
+    if(!validRWLock(lockID))
+    {
+        return;
+    }
+
+    int status = disableInterrupts();
+    RWLockDescriptor *l = &(rwLocks[lockID]);
+    if(l->writer == -1 && (!l->writerPreference || head(&(l->writersWaiting)) == -1))
+    {
+        l->readers++;
+    }
+    else
+    {
+        addLast(&(l->readersWaiting), currentProcess);
+        dispatch();
+    }
+    restoreInterrupts(status);
+}
+
+void readUnlock(int lockID)
+{
+    if(!validRWLock(lockID))
+    {
+        return;
+    }
+
+    int status = disableInterrupts();
+    RWLockDescriptor *l = &(rwLocks[lockID]);
+    if(l->readers == 0)
+    {
+        restoreInterrupts(status);
+        fprintf(stderr, "Error: reader-writer lock is not held for reading\n");
+        return;
+    }
+    if(--(l->readers) == 0)
+    {
+        passRWLock(l);
+    }
+    restoreInterrupts(status);
+}
+
+/**
+ * Takes the lock for writing, alone.
+ **/
+void writeLock(int lockID)
+{
+    if(!validRWLock(lockID))
+    {
+        return;
+    }
+
+    int status = disableInterrupts();
+    RWLockDescriptor *l = &(rwLocks[lockID]);
+    if(l->writer == -1 && l->readers == 0)
+    {
+        l->writer = currentProcess;
+    }
+    else
+    {
+        addLast(&(l->writersWaiting), currentProcess);
+        dispatch();
+    }
+    restoreInterrupts(status);
+}
+
+void writeUnlock(int lockID)
+{
+    if(!validRWLock(lockID))
+    {
+        return;
+    }
+
+    int status = disableInterrupts();
+    RWLockDescriptor *l = &(rwLocks[lockID]);
+    if(l->writer != currentProcess)
+    {
+        restoreInterrupts(status);
+        fprintf(stderr, "Error: reader-writer lock is not held for writing\n");
+        return;
+    }
+    l->writer = -1;
+    passRWLock(l);
+    restoreInterrupts(status);
+}
+
+#ifdef KERNEL_STATIC
+/**
+ * Static configuration: the descriptors of kernelConfig.h are already in
+ * .data, we lay out the first frame of each process, make them ready, free
+ * the rest of their slabs and number the cells of the channel rings.
+ **/
+void setupStatic()
+{
+    int i;
+    unsigned int j;
+
+    for(i = 0; i < STATIC_SLABS; i++)
+    {
+        staticSlabs[i] = &(staticDescriptors[i << SLAB_SHIFT]);
+    }
+    slabs = staticSlabs;
+    slabCount = STATIC_SLABS;
+    slabCapacity = STATIC_SLABS;
+
+    // the idle process is in no ready list, never preempts and is not waited for at exit
+    for(i = 0; i <= STATIC_PROCESSES; i++)
+    {
+        ProcessDescriptor *proc = &(PROCESS(i));
+        prepareStack(proc->stack, proc->stackSize);
+        proc->p = newProcess(processStart, proc->stack, proc->stackSize);
+        STATS(statsCreated(proc));
+        if(i < STATIC_PROCESSES)
+        {
+            makeReady(i);
+        }
+    }
+    idleProcesses[0] = STATIC_PROCESSES;
+    liveProcesses += STATIC_PROCESSES;
+    for(i = STATIC_PROCESSES + 1; i < STATIC_SLABS << SLAB_SHIFT; i++)
+    {
+        addLast(&freeDescriptors, i);
+    }
+
+    for(i = 0; i < STATIC_CHANNELS; i++)
+    {
+        for(j = 0; j <= channels[i].mask; j++)
+        {
+            channels[i].cells[j].sequence = j;
+        }
+    }
+}
+#endif
+
+#ifdef KERNEL_STATS
+/**
+ * Statistics
+ **/
+
+bool getProcessStats(int processId, ProcessStats* stats)
+{
+    int id = processId & (MAX_PROCESSES - 1);
+    bool alive = false;
+
+    int status = disableInterrupts();
+    if (id < slabCount << SLAB_SHIFT && PROCESS(id).alive &&
+        PROCESS(id).generation == processId >> INDEX_BITS)
+    {
+        // the time in the current state counts too
+        accountState(&(PROCESS(id)), read_timestamp());
+        *stats = PROCESS(id).stats;
+        alive = true;
+    }
+    restoreInterrupts(status);
+    return alive;
+}
+
+bool getMonitorStats(int monitorId, MonitorStats* stats)
+{
+    if(monitorId < 0 || monitorId >= nextMonitorID)
+    {
+        return false;
+    }
+    int status = disableInterrupts();
+    *stats = monitors[monitorId].stats;
+    restoreInterrupts(status);
+    return true;
+}
+
+bool getEventStats(int eventID, EventStats* stats)
+{
+    if(eventID < 0 || eventID >= nextEventID)
+    {
+        return false;
+    }
+    int status = disableInterrupts();
+    *stats = events[eventID].stats;
+    restoreInterrupts(status);
+    return true;
+}
+
+void statsDump()
+{
+    ProcessStats p;
+    MonitorStats m;
+    EventStats e;
+    int i, b;
+
+    for(i = 0; i < slabCount << SLAB_SHIFT; i++)
+    {
+        int processId = (PROCESS(i).generation << INDEX_BITS) | i;
+        if(!getProcessStats(processId, &p))
+        {
+            continue;
+        }
+        printf("stats process %d%s priority=%d running=%llu ready=%llu blocked=%llu voluntary=%u involuntary=%u wakeups=%u latency=",
+                processId, PROCESS(i).basePriority == PRIORITIES ? " idle" : "", PROCESS(i).basePriority,
+                p.runningCycles, p.readyCycles, p.blockedCycles,
+                p.voluntarySwitches, p.involuntarySwitches, p.wakeups);
+        for(b = 0; b < LATENCY_BUCKETS; b++)
+        {
+            printf(b ? ",%u" : "%u", p.latency[b]);
+        }
+        printf("\n");
+    }
+    for(i = 0; getMonitorStats(i, &m); i++)
+    {
+        printf("stats monitor %d entries=%u contentions=%u hold=%llu max_hold=%u\n",
+                i, m.entries, m.contentions, m.holdCycles, m.maxHoldCycles);
+    }
+    for(i = 0; getEventStats(i, &e); i++)
+    {
+        printf("stats event %d waits=%u fires=%u\n", i, e.waits, e.fires);
+    }
+}
+#endif
+
+#ifdef KERNEL_TRACE
+/**
+ * Tracing
+ **/
+
+TraceBuffer traceBuffer = { .magic = TRACE_MAGIC, .size = TRACE_SIZE, .frequency = TIMER_1_FREQ };
+
+int traceProcess()
+{
+    return currentProcess;
+}
+
+void traceDump()
+{
+    int status = disableInterrupts();
+    unsigned int first = 0;
+    unsigned int i;
+
+    if(traceBuffer.next > TRACE_SIZE)
+    {
+        first = traceBuffer.next - TRACE_SIZE; // the older ones have been overwritten
+    }
+    printf("trace begin %x %x %x %x\n", traceBuffer.magic, traceBuffer.size,
+            traceBuffer.frequency, traceBuffer.next);
+    for(i = first; i != traceBuffer.next; i++)
+    {
+        TraceRecord *r = &(traceBuffer.records[i & (TRACE_SIZE - 1)]);
+        printf("trace %x %x %x %x\n", r->time, r->type, (unsigned int) r->process, r->arg);
+    }
+    printf("trace end\n");
+    restoreInterrupts(status);
 }
+#endif
@@ -1,7 +1,66 @@
 #ifndef KERNEL_H_
 #define KERNEL_H_
 
-void createProcess(void (*f)(), int stackSize);
+#include <stdbool.h>
+
+// Number of priority levels, 0 is the highest one
+#define PRIORITIES 32
+
+// Priority of the processes created with createProcess
+#define DEFAULT_PRIORITY 16
+
+// Number of ticks the timed calls wait for to never time out
+#define WAIT_FOREVER -1
+
+/* Both return the id of the new process. */
+int createProcess(void (*f)(), int stackSize);
+
+int createProcessWithPriority(void (*f)(), int stackSize, int priority);
+
+/*
+ * Periodic process, scheduled earliest deadline first before all the
+ * others: f is run once every period timer ticks and each run (job) must
+ * be done by the next release. wcet is the number of ticks a job takes at
+ * worst. Returns -1, without creating it, if the utilization of the
+ * periodic processes (the sum of their wcet / period) would exceed the
+ * bound, the whole processor unless MAX_UTILIZATION (in millionths) is
+ * defined. The other processes run in what is left. Needs init_clock().
+ */
+int createPeriodicProcess(void (*f)(), int stackSize, int period, int wcet);
+
+/* Returns the number of jobs of a periodic process that were done after their deadline or skipped. */
+unsigned int deadlineMisses(int processId);
+
+/* Returns the id of the running process. */
+int getProcessId();
+
+/*
+ * Terminates the running process, which must not be in a monitor. Returning
+ * from the process function does the same. Its id and stack are reused by
+ * the processes created afterwards.
+ */
+void processExit();
+
+/* Waits until the process with the given id has exited. */
+void joinProcess(int processId);
+
+/* Returns the bytes the kernel got from malloc for stacks and descriptors. */
+unsigned int kernelHeapUsage();
+
+/* Returns the number of context switches since start(). */
+unsigned int kernelSwitches();
+
+/* Returns the number of processes a core took from the run queue of another one (KERNEL_CORES > 1). */
+unsigned int kernelSteals();
+
+#ifdef KERNEL_STACK_CHECK
+/*
+ * Returns the most bytes of its stack the process has used so far, or -1 if
+ * it has exited. Stacks are painted at creation with KERNEL_STACK_CHECK;
+ * without it, only the canary at their low end is checked at each switch.
+ */
+int stackHighWater(int processId);
+#endif
 
 void start();
 
@@ -9,22 +68,157 @@ int createMonitor();
 
 void enterMonitor(int monitorID);
 
+/*
+ * The timed calls give up after ticks timer ticks (0 does not block) and
+ * return false if they did. They need init_clock(). waitTimeout returns in
+ * the monitor either way.
+ */
+bool enterMonitorTimeout(int monitorID, int ticks);
+
 void exitMonitor();
 
 void wait();
 
+bool waitTimeout(int ticks);
+
 void notify();
 
 void notifyAll();
 
+/*
+ * Monitor owners inherit the priority of the processes queued to enter
+ * their monitors (on by default). Only meant for measurements.
+ */
+void setPriorityInheritance(bool enabled);
+
+/*
+ * Hand-off mode (off by default): when wait() or exitMonitor() release a
+ * monitor someone is queued on, the new owner runs right away instead of
+ * going to the tail of the ready list, unless a better process is ready.
+ * exitMonitor() then resumes once the new owner gives the processor away.
+ */
+void setMonitorHandOff(bool enabled);
+
 void yield();
 
+/* Suspends the running process for ticks timer ticks. Needs init_clock(). */
+void sleepTicks(int ticks);
+
+/* Returns the number of timer ticks since init_clock(). */
+unsigned int getTicks();
+
+/*
+ * Enables round-robin time slicing for the running process: after ticks
+ * timer interrupts it is preempted in favor of the next ready process of
+ * the same priority (0 disables it). If maskInMonitors is true, a slice
+ * that ends inside a monitor is extended until the last exitMonitor.
+ * Needs init_clock().
+ */
+void setQuantum(int ticks, bool maskInMonitors);
+
+/* Called by the timer interrupt handler on every tick, as its last action: it may switch. */
+void timerTick();
+
+/* Like timerTick, without charging the tick nor switching: for a timer interrupt that resumes iotransfer. */
+void expireTick();
+
+/*
+ * Event modes: a manual-reset event stays set until reinitialiser, an
+ * auto-reset event wakes a single waiter (or the next one to come) and
+ * resets itself, a pulse wakes the current waiters and never stays set.
+ */
+#define EVENT_MANUAL_RESET 0
+#define EVENT_AUTO_RESET 1
+#define EVENT_PULSE 2
+
+/* Both return the id of the new event, createEvent makes a manual-reset one. */
 int createEvent();
 
+int createEventWithMode(int mode);
+
 void attendre(int eventID);
 
+bool attendreTimeout(int eventID, int ticks);
+
 void declencher(int eventID);
 
 void reinitialiser(int eventID);
 
+/*
+ * Channels pass int messages through a ring of capacity slots (rounded up
+ * to a power of two). If single is true, at most one process or ISR sends
+ * and one receives at a time, which saves the compare and swap.
+ */
+int createChannel(int capacity, bool single);
+
+/* Non-blocking, they return false if the channel is full or empty. */
+bool trySend(int channelID, int message);
+
+bool tryRecv(int channelID, int* message);
+
+/* Same as trySend, for interrupt routines (button, timer...). */
+bool isrSend(int channelID, int message);
+
+/* Blocking, they wait for room or for a message. */
+void channelSend(int channelID, int message);
+
+int channelRecv(int channelID);
+
+/*
+ * Deferred interrupt work. An interrupt routine only acknowledges its
+ * device and posts a record on the ring of its vector (0 timer, 1 buttons,
+ * then those of registerInterruptVector); the processes blocked in
+ * waitInterrupt get the records from a kernel process of priority 0, in
+ * batches. A process that is not blocked takes the records left in the
+ * ring without being woken up.
+ */
+typedef struct {
+    int vector;
+    unsigned int bits; // device bits captured by the routine, the button edges for vector 1
+    unsigned int time; // read_timestamp() when the routine posted it
+} InterruptRecord;
+
+/*
+ * Results of postInterrupt: the record is queued, dropped because the ring
+ * of the vector is full (and counted by lostInterrupts), or refused because
+ * no process has waited for the vector yet.
+ */
+#define INTERRUPT_POSTED 0
+#define INTERRUPT_LOST 1
+#define INTERRUPT_UNARMED 2
+
+/* For interrupt routines, returns one of the results above. */
+int postInterrupt(int vector, unsigned int bits);
+
+/* Like postInterrupt, but the deferred work process is only made ready: timerTick switches to it. */
+int postInterruptLater(int vector, unsigned int bits);
+
+/* Waits for the next record of vector and copies it to record. */
+void waitInterrupt(int vector, InterruptRecord* record);
+
+/* Returns the number of records of vector dropped because its ring was full. */
+unsigned int lostInterrupts(int vector);
+
+/* Counting semaphore created with count units. */
+int createSemaphore(int count);
+
+void semaphoreWait(int semaphoreID);
+
+void semaphoreSignal(int semaphoreID);
+
+/*
+ * Reader-writer lock: any number of readers or a single writer. Without
+ * the writer preference, readers keep entering while writers wait; with
+ * it, a waiting writer holds back the new readers.
+ */
+int createRWLock(bool writerPreference);
+
+void readLock(int lockID);
+
+void readUnlock(int lockID);
+
+void writeLock(int lockID);
+
+void writeUnlock(int lockID);
+
 #endif /*KERNEL_H_*/
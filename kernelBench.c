@@ -0,0 +1,1414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "system.h"
+#include "sys/alt_irq.h"
+#include "kernel.h"
+#include "interrupt.h"
+#include "system_m.h"
+#include "trace.h"
+#include "stats.h"
+#include "task.h"
+#ifdef KERNEL_STATIC
+#include "kernelConfig.h"
+#endif
+#ifndef __nios2__
+#include "hal.h"
+#endif
+
+/*
+ * Headless kernel benchmarks. Runs on the board (output on the JTAG UART)
+ * and in the hosted build. Every result is printed on one line:
+ *
+ *   bench <name> ops=<n> cycles=<total> cycles_per_op=<total / n, 2 decimals>
+ *
+ * or, for memory figures, bench <name> bytes=<n>
+ * or, for throughputs, bench <name> ops_per_sec=<n>
+ * or, for event counts, bench <name> count=<n>
+ * or, for context switches, bench <name> ops=<n> switches=<total> switches_per_op=<2 decimals>
+ * where cycles are timer_1 clock cycles (TIMER_1_FREQ).
+ * Built with -DKERNEL_TRACE, the trace of the last benchmark follows, and
+ * with -DKERNEL_STATS the statistics of the processes, monitors and events.
+ * With -DKERNEL_STACK_CHECK, the deepest worker stack is reported, to be
+ * compared with STACK_SIZE. With -DKERNEL_STATIC, the objects main() creates
+ * come from kernelConfig.h instead: compare boot, data_size and bss_size.
+ * The core_scaling results need a hosted build with -DKERNEL_CORES=<n>,
+ * the irq_burst ones a hosted single core build, which emulates the presses.
+ * Built with -DKERNEL_ONCHIP on the board, onchip_size tells how much of
+ * onchip_mem the kernel takes: compare the switch and timer_isr results
+ * with those of the default placement.
+ * host/benchCompare.c compares the output of two builds.
+ */
+
+#define STACK_SIZE	16384
+#define ROUNDS		100000
+#define WORKERS		4
+#define MAX_SCALING	32
+
+/* Buffer implemented using monitors, same as kernelTest1.c */
+typedef struct {
+	int message;
+	int full;
+	int monitor;
+} Buffer;
+
+void initBuffer(Buffer* b) {
+	b->monitor = createMonitor();
+	b->full = 0;
+}
+
+void put(Buffer* b, int m) {
+	enterMonitor(b->monitor);
+	while(b->full) {
+		wait();
+	}
+	b->message = m;
+	b->full = 1;
+	notify();
+	exitMonitor();
+}
+
+int get(Buffer* b) {
+	int m;
+
+	enterMonitor(b->monitor);
+	while(!b->full) {
+		wait();
+	}
+	m = b->message;
+	b->full = 0;
+	notifyAll();
+	exitMonitor();
+
+	return m;
+}
+
+/*
+ * Buffer implemented using events, as in kernelTest1.c but with auto-reset
+ * events: attendre takes the event, so that any number of producers and
+ * consumers can share the buffer without the reinitialiser calls.
+ */
+typedef struct {
+	int message;
+	int fullEvent;
+	int emptyEvent;
+} EventBuffer;
+
+void initEventBuffer(EventBuffer* b) {
+	b->emptyEvent = createEventWithMode(EVENT_AUTO_RESET);
+	b->fullEvent = createEventWithMode(EVENT_AUTO_RESET);
+	declencher(b->emptyEvent);
+}
+
+void eput(EventBuffer* b, int m) {
+	attendre(b->emptyEvent);
+	b->message = m;
+	declencher(b->fullEvent);
+}
+
+int eget(EventBuffer* b) {
+	int m;
+
+	attendre(b->fullEvent);
+	m = b->message;
+	declencher(b->emptyEvent);
+	return m;
+}
+
+/* signaled by the last worker of a benchmark, the driver waits on it */
+int doneEvent;
+/* protects workersLeft from workers preempted by the timer */
+int doneMonitor;
+
+int workersLeft;
+#ifdef KERNEL_STACK_CHECK
+int workerStackUsed = 0;
+#endif
+Buffer buffer;
+EventBuffer eventBuffer;
+
+void report(const char* name, unsigned int ops, unsigned int cycles) {
+	unsigned long long centi = ops ? (unsigned long long) cycles * 100 / ops : 0;
+
+	printf("bench %s ops=%u cycles=%u cycles_per_op=%llu.%02llu\n",
+			name, ops, cycles, centi / 100, centi % 100);
+}
+
+void reportRate(const char* name, unsigned int ops, unsigned int cycles) {
+	printf("bench %s ops_per_sec=%llu\n", name,
+			cycles ? (unsigned long long) ops * TIMER_1_FREQ / cycles : 0);
+}
+
+void reportSwitches(const char* name, unsigned int ops, unsigned int switches) {
+	unsigned long long centi = ops ? (unsigned long long) switches * 100 / ops : 0;
+
+	printf("bench %s ops=%u switches=%u switches_per_op=%llu.%02llu\n",
+			name, ops, switches, centi / 100, centi % 100);
+}
+
+/* must be called before creating the workers of a benchmark */
+void expectWorkers(int count) {
+	reinitialiser(doneEvent);
+	workersLeft = count;
+}
+
+/* called by each worker when its loop is over, the worker exits */
+void workerDone() {
+#ifdef KERNEL_STACK_CHECK
+	int used = stackHighWater(getProcessId());
+	if (used > workerStackUsed) {
+		workerStackUsed = used;
+	}
+#endif
+	enterMonitor(doneMonitor);
+	if (--workersLeft == 0) {
+		declencher(doneEvent);
+	}
+	exitMonitor();
+}
+
+/* lets the workers run and returns the cycles until the last one is done */
+unsigned int waitWorkers() {
+	unsigned int start = read_timestamp();
+	attendre(doneEvent);
+	return read_timestamp() - start;
+}
+
+/*********************** yield ping-pong *********************/
+void pingPong() {
+	int i;
+	for (i = 0; i < ROUNDS; i++) {
+		yield();
+	}
+	workerDone();
+}
+
+/*********************** monitor hand-off *********************/
+void handoffProducer() {
+	int i;
+	for (i = 0; i < ROUNDS; i++) {
+		put(&buffer, i);
+	}
+	workerDone();
+}
+
+void handoffConsumer() {
+	int i;
+	for (i = 0; i < ROUNDS; i++) {
+		get(&buffer);
+	}
+	workerDone();
+}
+
+/*********************** Buffer throughput, with and without hand-off *********************/
+#define MAX_PAIRS	8
+
+int pairRounds;
+
+void bufferProducer() {
+	int i;
+	for (i = 0; i < pairRounds; i++) {
+		put(&buffer, i);
+	}
+	workerDone();
+}
+
+void bufferConsumer() {
+	int i;
+	for (i = 0; i < pairRounds; i++) {
+		get(&buffer);
+	}
+	workerDone();
+}
+
+/* n producers and n consumers share the same Buffer */
+void benchBufferThroughput() {
+	char name[40];
+	unsigned int cycles;
+	int handOff, n, i;
+
+	for (handOff = 0; handOff <= 1; handOff++) {
+		setMonitorHandOff(handOff);
+		for (n = 1; n <= MAX_PAIRS; n *= 2) {
+			pairRounds = ROUNDS / n;
+			expectWorkers(2 * n);
+			for (i = 0; i < n; i++) {
+				createProcess(bufferProducer, STACK_SIZE);
+				createProcess(bufferConsumer, STACK_SIZE);
+			}
+			cycles = waitWorkers();
+			sprintf(name, "buffer_%s_%d", handOff ? "handoff" : "queued", n);
+			report(name, n * pairRounds, cycles);
+			reportRate(name, n * pairRounds, cycles);
+		}
+	}
+	setMonitorHandOff(false);
+}
+
+/*********************** EventBuffer throughput *********************/
+void eventBufferProducer() {
+	int i;
+	for (i = 0; i < pairRounds; i++) {
+		eput(&eventBuffer, i);
+	}
+	workerDone();
+}
+
+void eventBufferConsumer() {
+	int i;
+	for (i = 0; i < pairRounds; i++) {
+		eget(&eventBuffer);
+	}
+	workerDone();
+}
+
+/* n producers and n consumers share the same EventBuffer */
+void benchEventBufferThroughput() {
+	char name[40];
+	unsigned int cycles;
+	int n, i;
+
+	for (n = 1; n <= MAX_PAIRS; n *= 2) {
+		pairRounds = ROUNDS / n;
+		expectWorkers(2 * n);
+		for (i = 0; i < n; i++) {
+			createProcess(eventBufferProducer, STACK_SIZE);
+			createProcess(eventBufferConsumer, STACK_SIZE);
+		}
+		cycles = waitWorkers();
+		sprintf(name, "eventbuffer_%d", n);
+		report(name, n * pairRounds, cycles);
+		reportRate(name, n * pairRounds, cycles);
+	}
+}
+
+/*********************** channel throughput *********************/
+#define CHANNEL_CAPACITY	64
+
+int spscChannel, mpmcChannel, benchChannel;
+
+void channelProducer() {
+	int i;
+	for (i = 0; i < pairRounds; i++) {
+		channelSend(benchChannel, i);
+	}
+	workerDone();
+}
+
+void channelConsumer() {
+	int i;
+	for (i = 0; i < pairRounds; i++) {
+		channelRecv(benchChannel);
+	}
+	workerDone();
+}
+
+/* same as benchBufferThroughput, through channels */
+void benchChannelThroughput() {
+	char name[40];
+	unsigned int start, cycles;
+	int n, i, m;
+
+	/* non-blocking fast path, without any switch */
+	start = read_timestamp();
+	for (i = 0; i < ROUNDS; i++) {
+		trySend(spscChannel, i);
+		tryRecv(spscChannel, &m);
+	}
+	report("channel_try_pair", ROUNDS, read_timestamp() - start);
+
+	benchChannel = spscChannel;
+	pairRounds = ROUNDS;
+	expectWorkers(2);
+	createProcess(channelProducer, STACK_SIZE);
+	createProcess(channelConsumer, STACK_SIZE);
+	cycles = waitWorkers();
+	report("channel_spsc_1", ROUNDS, cycles);
+	reportRate("channel_spsc_1", ROUNDS, cycles);
+
+	benchChannel = mpmcChannel;
+	for (n = 1; n <= MAX_PAIRS; n *= 2) {
+		pairRounds = ROUNDS / n;
+		expectWorkers(2 * n);
+		for (i = 0; i < n; i++) {
+			createProcess(channelProducer, STACK_SIZE);
+			createProcess(channelConsumer, STACK_SIZE);
+		}
+		cycles = waitWorkers();
+		sprintf(name, "channel_mpmc_%d", n);
+		report(name, n * pairRounds, cycles);
+		reportRate(name, n * pairRounds, cycles);
+	}
+}
+
+/*********************** nested monitors *********************/
+int dummyMonitor1, dummyMonitor2;
+
+/* uncontended and reentrant enter/exit, same nesting as producer() in kernelTest1.c */
+void benchNestedMonitors() {
+	unsigned int start;
+	int i;
+
+	start = read_timestamp();
+	for (i = 0; i < ROUNDS; i++) {
+		enterMonitor(dummyMonitor1);
+		enterMonitor(dummyMonitor2);
+		enterMonitor(dummyMonitor1);
+		exitMonitor();
+		exitMonitor();
+		exitMonitor();
+	}
+	report("monitor_nested_pair", 3 * ROUNDS, read_timestamp() - start);
+}
+
+/*********************** read-mostly table *********************/
+#define TABLE_SIZE	16
+#define MAX_READERS	16
+
+int table[TABLE_SIZE];
+int tableMonitor, tableLock;
+int readRounds;
+
+int readTable() {
+	int i, sum = 0;
+	for (i = 0; i < TABLE_SIZE; i++) {
+		sum += table[i];
+	}
+	return sum;
+}
+
+/* the yield stands for a reader losing the processor in the middle of a read */
+void monitorReader() {
+	int i;
+	for (i = 0; i < readRounds; i++) {
+		enterMonitor(tableMonitor);
+		readTable();
+		yield();
+		exitMonitor();
+	}
+	workerDone();
+}
+
+void rwReader() {
+	int i;
+	for (i = 0; i < readRounds; i++) {
+		readLock(tableLock);
+		readTable();
+		yield();
+		readUnlock(tableLock);
+	}
+	workerDone();
+}
+
+volatile unsigned int tableWrites;
+
+void rwWriter() {
+	writeLock(tableLock);
+	table[0]++;
+	tableWrites++;
+	writeUnlock(tableLock);
+}
+
+/* a readUnlock without readLock is refused on stderr, out of the bench log; a writer still gets the lock at once */
+void benchUnmatchedReadUnlock() {
+	int i;
+
+	readUnlock(tableLock);
+	tableWrites = 0;
+	createProcess(rwWriter, STACK_SIZE);
+	for (i = 0; i < 1000 && tableWrites == 0; i++) {
+		yield();
+	}
+	printf("bench rwlock_unmatched_unlock_writes count=%u\n", tableWrites);
+}
+
+/* a writeUnlock without writeLock is refused, a writer waits for the reader */
+void benchUnmatchedWriteUnlock() {
+	unsigned int held;
+	int i;
+
+	readLock(tableLock);
+	tableWrites = 0;
+	createProcess(rwWriter, STACK_SIZE);
+	writeUnlock(tableLock);
+	for (i = 0; i < 1000; i++) {
+		yield();
+	}
+	held = tableWrites;
+	readUnlock(tableLock);
+	for (i = 0; i < 1000 && tableWrites == 0; i++) {
+		yield();
+	}
+	printf("bench rwlock_unmatched_write_unlock_held_writes count=%u\n", held);
+	printf("bench rwlock_unmatched_write_unlock_writes count=%u\n", tableWrites);
+}
+
+/* n readers share the table, through a monitor or a reader-writer lock */
+void benchReaders() {
+	char name[40];
+	unsigned int cycles;
+	int rw, n, i;
+
+	for (rw = 0; rw <= 1; rw++) {
+		for (n = 1; n <= MAX_READERS; n *= 4) {
+			readRounds = ROUNDS / n;
+			expectWorkers(n);
+			for (i = 0; i < n; i++) {
+				createProcess(rw ? rwReader : monitorReader, STACK_SIZE);
+			}
+			cycles = waitWorkers();
+			sprintf(name, "%s_read_%d", rw ? "rwlock" : "monitor", n);
+			report(name, n * readRounds, cycles);
+			reportRate(name, n * readRounds, cycles);
+		}
+	}
+	benchUnmatchedReadUnlock();
+	benchUnmatchedWriteUnlock();
+}
+
+/*********************** event delivery to many consumers *********************/
+#define DELIVERIES	10000
+#define MAX_CONSUMERS	64
+
+/* indexed by the mode, manual-reset or auto-reset */
+int deliveryEvents[2];
+int deliveryAck;
+int deliveryMode;
+int deliveryToken;
+int deliveryStop;
+
+/* the eget pattern of kernelTest1.c: whoever comes first takes the token */
+void eventConsumer() {
+	int event = deliveryEvents[deliveryMode];
+
+	for (;;) {
+		attendre(event);
+		if (deliveryStop) {
+			break;
+		}
+		if (deliveryToken) {
+			deliveryToken = 0;
+			reinitialiser(event);
+			semaphoreSignal(deliveryAck);
+		}
+	}
+	workerDone();
+}
+
+/* a manual-reset event wakes every consumer for each token, an auto-reset one a single */
+void benchEventDelivery() {
+	char name[40];
+	unsigned int start, switches;
+	int n, i;
+
+	for (deliveryMode = 0; deliveryMode <= 1; deliveryMode++) {
+		for (n = 1; n <= MAX_CONSUMERS; n *= 8) {
+			int event = deliveryEvents[deliveryMode];
+
+			deliveryStop = 0;
+			reinitialiser(event);
+			expectWorkers(n);
+			for (i = 0; i < n; i++) {
+				createProcess(eventConsumer, STACK_SIZE);
+			}
+			yield(); // the consumers wait for the first token
+
+			switches = kernelSwitches();
+			start = read_timestamp();
+			for (i = 0; i < DELIVERIES; i++) {
+				deliveryToken = 1;
+				declencher(event);
+				semaphoreWait(deliveryAck);
+			}
+			start = read_timestamp() - start;
+			switches = kernelSwitches() - switches;
+
+			deliveryStop = 1;
+			for (i = 0; i < n; i++) {
+				declencher(event);
+			}
+			waitWorkers();
+			sprintf(name, "event_%s_%d", deliveryMode ? "auto" : "manual", n);
+			report(name, DELIVERIES, start);
+			reportSwitches(name, DELIVERIES, switches);
+		}
+	}
+}
+
+/*********************** scheduler throughput *********************/
+void yielder() {
+	int i;
+	for (i = 0; i < ROUNDS; i++) {
+		yield();
+	}
+	workerDone();
+}
+
+/*********************** yield latency vs. number of processes *********************/
+int scalingRounds;
+
+void scalingYielder() {
+	int i;
+	for (i = 0; i < scalingRounds; i++) {
+		yield();
+	}
+	workerDone();
+}
+
+/* the total number of yields is the same for every process count */
+void benchYieldScaling() {
+	char name[32];
+	int n, i;
+
+	for (n = 2; n <= MAX_SCALING; n *= 2) {
+		scalingRounds = ROUNDS / n;
+		expectWorkers(n);
+		for (i = 0; i < n; i++) {
+			createProcess(scalingYielder, STACK_SIZE);
+		}
+		sprintf(name, "yield_scaling_%d", n);
+		report(name, n * scalingRounds, waitWorkers());
+	}
+}
+
+/*********************** dispatch latency vs. number of ready processes *********************/
+#define DISPATCHES	10000
+#define HIGH_PRIORITY	(DEFAULT_PRIORITY - 8)
+#define LOW_PRIORITY	(DEFAULT_PRIORITY + 4)
+
+int fireEvent;
+volatile int dispatchStop;
+unsigned int firedAt, dispatchTotal, dispatchMax;
+
+/* woken by the low priority firer, measures how long it took to run */
+void dispatchReceiver() {
+	int i;
+	unsigned int latency;
+
+	dispatchTotal = 0;
+	dispatchMax = 0;
+	for (i = 0; i < DISPATCHES; i++) {
+		attendre(fireEvent);
+		latency = read_timestamp() - firedAt;
+		reinitialiser(fireEvent);
+		dispatchTotal += latency;
+		if (latency > dispatchMax) {
+			dispatchMax = latency;
+		}
+	}
+	dispatchStop = 1;
+	workerDone();
+}
+
+void dispatchFirer() {
+	while (!dispatchStop) {
+		firedAt = read_timestamp();
+		declencher(fireEvent);
+		yield();
+	}
+	workerDone();
+}
+
+void dispatchFiller() {
+	while (!dispatchStop) {
+		yield();
+	}
+	workerDone();
+}
+
+/* the receiver must preempt the firer whatever the number of ready fillers */
+void benchDispatchLatency() {
+	char name[40];
+	int n, i;
+
+	for (n = 1; n <= MAX_SCALING; n *= 4) {
+		dispatchStop = 0;
+		reinitialiser(fireEvent);
+		expectWorkers(n + 2);
+		createProcessWithPriority(dispatchReceiver, STACK_SIZE, HIGH_PRIORITY);
+		for (i = 0; i < n; i++) {
+			createProcessWithPriority(dispatchFiller, STACK_SIZE, LOW_PRIORITY);
+		}
+		createProcessWithPriority(dispatchFirer, STACK_SIZE, LOW_PRIORITY);
+		waitWorkers();
+		sprintf(name, "dispatch_latency_%d", n);
+		report(name, DISPATCHES, dispatchTotal);
+		sprintf(name, "dispatch_latency_max_%d", n);
+		report(name, 1, dispatchMax);
+	}
+}
+
+/*********************** priority inversion *********************/
+#define CRITICAL_WORK	1000000
+
+int inversionMonitor, inversionEvent;
+unsigned int blockedTime;
+
+void busyWork(int amount) {
+	volatile int i;
+	for (i = 0; i < amount; i++);
+}
+
+/* high priority: blocked by the low priority owner of the monitor */
+void inversionHigh() {
+	unsigned int before;
+
+	attendre(inversionEvent);
+	before = read_timestamp();
+	enterMonitor(inversionMonitor);
+	blockedTime = read_timestamp() - before;
+	exitMonitor();
+	workerDone();
+}
+
+/* medium priority: does not use the monitor but hogs the processor */
+void inversionMedium() {
+	attendre(inversionEvent);
+	busyWork(4 * CRITICAL_WORK);
+	workerDone();
+}
+
+/* low priority: wakes the others while it owns the monitor */
+void inversionLow() {
+	enterMonitor(inversionMonitor);
+	declencher(inversionEvent);
+	busyWork(CRITICAL_WORK);
+	exitMonitor();
+	workerDone();
+}
+
+/* without inheritance the high priority process also waits for the medium one */
+void benchPriorityInversion() {
+	int inherit;
+
+	for (inherit = 0; inherit <= 1; inherit++) {
+		setPriorityInheritance(inherit);
+		reinitialiser(inversionEvent);
+		expectWorkers(3);
+		createProcessWithPriority(inversionHigh, STACK_SIZE, HIGH_PRIORITY);
+		createProcessWithPriority(inversionMedium, STACK_SIZE, DEFAULT_PRIORITY - 4);
+		createProcessWithPriority(inversionLow, STACK_SIZE, LOW_PRIORITY);
+		waitWorkers();
+		report(inherit ? "inversion_blocked_inherit" : "inversion_blocked_no_inherit", 1, blockedTime);
+	}
+}
+
+/*********************** process churn *********************/
+#define CHURN		8192
+#define CHURN_BATCH	64
+
+int churned;
+
+void shortLived() {
+	churned++;
+}
+
+/* spawn/exit throughput; stacks and ids of exited processes are reused */
+void benchProcessChurn() {
+	unsigned int start, heapBefore;
+	int ids[CHURN_BATCH];
+	int i, j;
+
+	heapBefore = kernelHeapUsage();
+	start = read_timestamp();
+	for (i = 0; i < CHURN; i++) {
+		joinProcess(createProcess(shortLived, STACK_SIZE));
+	}
+	report("spawn_join", CHURN, read_timestamp() - start);
+
+	start = read_timestamp();
+	for (i = 0; i < CHURN; i += CHURN_BATCH) {
+		for (j = 0; j < CHURN_BATCH; j++) {
+			ids[j] = createProcessWithPriority(shortLived, STACK_SIZE, LOW_PRIORITY);
+		}
+		for (j = 0; j < CHURN_BATCH; j++) {
+			joinProcess(ids[j]);
+		}
+	}
+	report("spawn_join_batch", i, read_timestamp() - start);
+	printf("bench churn_heap_growth bytes=%u\n", kernelHeapUsage() - heapBefore);
+}
+
+/*********************** create to first run *********************/
+#define FIRST_RUNS	4096
+
+unsigned int createdAt, firstRunTotal, firstRunMax;
+
+void firstRun() {
+	unsigned int latency = read_timestamp() - createdAt;
+
+	firstRunTotal += latency;
+	if (latency > firstRunMax) {
+		firstRunMax = latency;
+	}
+}
+
+/*
+ * Cycles from createProcess to the first instruction of the new process.
+ * A better process preempts its creator at once, an equal one runs when
+ * the creator blocks in joinProcess.
+ */
+void firstRunLatency(const char* kind, int priority) {
+	char name[40];
+	int i;
+
+	firstRunTotal = 0;
+	firstRunMax = 0;
+	for (i = 0; i < FIRST_RUNS; i++) {
+		createdAt = read_timestamp();
+		joinProcess(createProcessWithPriority(firstRun, STACK_SIZE, priority));
+	}
+	sprintf(name, "first_run_%s", kind);
+	report(name, FIRST_RUNS, firstRunTotal);
+	sprintf(name, "first_run_max_%s", kind);
+	report(name, 1, firstRunMax);
+}
+
+void benchFirstRun() {
+	firstRunLatency("preempt", HIGH_PRIORITY);
+	firstRunLatency("join", DEFAULT_PRIORITY);
+}
+
+/*********************** raw context switch cost *********************/
+extern CORE_LOCAL Process running;
+
+Process benchContext, partnerContext;
+int partnerFull;
+
+/* bounces the processor back, with the frame chosen by the driver */
+void switchPartner() {
+	while (1) {
+		if (partnerFull) {
+			transfer(benchContext);
+		}
+		else {
+			transferVoluntary(benchContext);
+		}
+	}
+}
+
+/*
+ * Round trips between the driver and a bare process, below the scheduler.
+ * transfer_full saves the frame an ISR switch uses, transfer_voluntary the
+ * callee-saved one, and transfer_mixed resumes each kind of frame with the
+ * other one.
+ */
+void benchTransfer() {
+	static const char* names[] = { "transfer_voluntary", "transfer_full", "transfer_mixed" };
+	unsigned int* stack = malloc(STACK_SIZE);
+	unsigned int start;
+	int status, mode, i;
+
+	status = disableInterrupts();
+	benchContext = running;
+	partnerContext = newProcess(switchPartner, stack, STACK_SIZE);
+	for (mode = 0; mode < 3; mode++) {
+		partnerFull = mode != 0;
+		start = read_timestamp();
+		for (i = 0; i < ROUNDS; i++) {
+			if (mode == 1) {
+				transfer(partnerContext);
+			}
+			else {
+				transferVoluntary(partnerContext);
+			}
+		}
+		report(names[mode], 2 * ROUNDS, read_timestamp() - start);
+	}
+	restoreInterrupts(status);
+	free(stack);
+}
+
+/*********************** stackless tasks vs. processes *********************/
+#define FANOUT		512
+#define FANOUT_STACK	4096
+
+typedef struct {
+	Task task;
+	int round;
+} BenchTask;
+
+BenchTask taskStates[FANOUT];
+
+/* a TASK_YIELD is a return to the runner and a call, no switch */
+int taskPingPong(Task* t) {
+	BenchTask* b = (BenchTask*) t;
+
+	TASK_BEGIN(t);
+	for (b->round = 0; b->round < ROUNDS; b->round++) {
+		TASK_YIELD(t);
+	}
+	TASK_ENTER(t, doneMonitor);
+	if (--workersLeft == 0) {
+		declencher(doneEvent);
+	}
+	exitMonitor();
+	TASK_END(t);
+}
+
+/* eput and eget of a single producer and consumer, the locals go in the task */
+int taskProducer(Task* t) {
+	BenchTask* b = (BenchTask*) t;
+
+	TASK_BEGIN(t);
+	for (b->round = 0; b->round < ROUNDS; b->round++) {
+		TASK_ATTENDRE(t, eventBuffer.emptyEvent);
+		eventBuffer.message = b->round;
+		declencher(eventBuffer.fullEvent);
+	}
+	TASK_ENTER(t, doneMonitor);
+	if (--workersLeft == 0) {
+		declencher(doneEvent);
+	}
+	exitMonitor();
+	TASK_END(t);
+}
+
+int taskConsumer(Task* t) {
+	BenchTask* b = (BenchTask*) t;
+
+	TASK_BEGIN(t);
+	for (b->round = 0; b->round < ROUNDS; b->round++) {
+		TASK_ATTENDRE(t, eventBuffer.fullEvent);
+		declencher(eventBuffer.emptyEvent);
+	}
+	TASK_ENTER(t, doneMonitor);
+	if (--workersLeft == 0) {
+		declencher(doneEvent);
+	}
+	exitMonitor();
+	TASK_END(t);
+}
+
+void fanoutWaiter() {
+	attendre(fireEvent);
+	workerDone();
+}
+
+int fanoutTask(Task* t) {
+	TASK_BEGIN(t);
+	TASK_ATTENDRE(t, fireEvent);
+	TASK_ENTER(t, doneMonitor);
+	if (--workersLeft == 0) {
+		declencher(doneEvent);
+	}
+	exitMonitor();
+	TASK_END(t);
+}
+
+/*
+ * Switch cost and memory of a task against a process: yield and EventBuffer
+ * ping-pong (to compare with yield_pingpong and eventbuffer_1), FANOUT
+ * waiters woken by one declencher, and the bytes each waiter takes. The
+ * bytes of a process are the kernel heap it adds, its stack and descriptor.
+ */
+void benchTasks() {
+	unsigned int heap, start;
+	int i;
+
+	expectWorkers(2);
+	createTask(&taskStates[0].task, taskPingPong);
+	createTask(&taskStates[1].task, taskPingPong);
+	report("task_yield_pingpong", 2 * ROUNDS, waitWorkers());
+
+	expectWorkers(2);
+	createTask(&taskStates[0].task, taskProducer);
+	createTask(&taskStates[1].task, taskConsumer);
+	report("task_eventbuffer", ROUNDS, waitWorkers());
+
+	reinitialiser(fireEvent);
+	expectWorkers(FANOUT);
+	heap = kernelHeapUsage();
+	for (i = 0; i < FANOUT; i++) {
+		createProcess(fanoutWaiter, FANOUT_STACK);
+	}
+	heap = kernelHeapUsage() - heap;
+	yield(); // the waiters block on the event
+	start = read_timestamp();
+	declencher(fireEvent);
+	waitWorkers();
+	report("process_fanout", FANOUT, read_timestamp() - start);
+	printf("bench process_bytes bytes=%u\n", heap / FANOUT);
+
+	reinitialiser(fireEvent);
+	expectWorkers(FANOUT);
+	for (i = 0; i < FANOUT; i++) {
+		createTask(&taskStates[i].task, fanoutTask);
+	}
+	yield();
+	start = read_timestamp();
+	declencher(fireEvent);
+	waitWorkers();
+	report("task_fanout", FANOUT, read_timestamp() - start);
+	printf("bench task_bytes bytes=%u\n", (unsigned int) sizeof(BenchTask));
+}
+
+/*********************** timer accuracy and ISR cost *********************/
+#define SLEEPERS	2048
+#define SLEEPER_STACK	8192
+#define SLEEPS		4
+#define TICK_CYCLES	(TIMER_1_FREQ / 1000)
+
+volatile int timerStop;
+int sleepersStarted;
+unsigned int lateTotal, lateMax, isrCycles, isrMax, isrTicks, entryCycles, entryMax;
+bool measureIsr;
+
+/* same as handle_timer_interrupts, timed, with the delay from the timeout to its first line */
+void measuredTimerIsr(void* context, alt_u32 id) {
+	unsigned int entry = clock_since_tick();
+	unsigned int before = read_timestamp();
+	unsigned int cycles;
+
+	handle_timer_interrupts(context, id);
+	cycles = read_timestamp() - before;
+	if (measureIsr) {
+		entryCycles += entry;
+		if (entry > entryMax) {
+			entryMax = entry;
+		}
+		isrCycles += cycles;
+		isrTicks++;
+		if (cycles > isrMax) {
+			isrMax = cycles;
+		}
+	}
+}
+
+/* sleeps from 1 to 200 ticks, so the timers spread over two wheel levels */
+void sleeper() {
+	int seed = sleepersStarted++;
+	int i;
+	unsigned int ticks, elapsed, late;
+
+	for (i = 0; i < SLEEPS; i++) {
+		ticks = 1 + (seed * 37 + i * 11) % 200;
+		elapsed = read_timestamp();
+		sleepTicks(ticks);
+		elapsed = read_timestamp() - elapsed;
+		late = elapsed > ticks * TICK_CYCLES ? elapsed - ticks * TICK_CYCLES : 0;
+		lateTotal += late;
+		if (late > lateMax) {
+			lateMax = late;
+		}
+	}
+	workerDone();
+}
+
+/* keeps a process ready while everybody sleeps, the timer never preempts it */
+void timerSpinner() {
+	while (!timerStop) {
+		yield();
+	}
+}
+
+void benchTimers() {
+	int i;
+
+	alt_irq_register(TIMER_IRQ, NULL, measuredTimerIsr);
+	timerStop = 0;
+	sleepersStarted = 0;
+	lateTotal = lateMax = isrCycles = isrMax = isrTicks = entryCycles = entryMax = 0;
+	createProcess(timerSpinner, STACK_SIZE);
+	expectWorkers(SLEEPERS);
+	for (i = 0; i < SLEEPERS; i++) {
+		createProcess(sleeper, SLEEPER_STACK);
+	}
+	measureIsr = true;
+	waitWorkers();
+	measureIsr = false;
+	timerStop = 1;
+	report("timer_lateness", SLEEPERS * SLEEPS, lateTotal);
+	report("timer_lateness_max", 1, lateMax);
+	report("timer_isr_entry", isrTicks, entryCycles);
+	report("timer_isr_entry_max", 1, entryMax);
+	report("timer_isr", isrTicks, isrCycles);
+	report("timer_isr_max", 1, isrMax);
+}
+
+/*********************** interrupts taken while idle *********************/
+#define IDLE_TICKS	200
+
+/* nothing else is ready while the driver sleeps, the timer should only fire at its deadline */
+void benchIdle() {
+	unsigned int ticks = getTicks();
+
+	isrTicks = 0;
+	measureIsr = true;
+	sleepTicks(IDLE_TICKS);
+	measureIsr = false;
+	printf("bench idle_ticks count=%u\n", getTicks() - ticks);
+	printf("bench idle_interrupts count=%u\n", isrTicks);
+}
+
+/*********************** deferred interrupt work *********************/
+#if !defined(__nios2__) && KERNEL_CORES == 1
+#define BURSTS		1000
+#define MAX_BURST	16
+
+int burstSize;
+unsigned int burstLatency;
+
+/* only the first record of a burst has to wake it up, it finds the others in the ring */
+void buttonWaiter() {
+	InterruptRecord record;
+	int i, j;
+
+	burstLatency = 0;
+	for (i = 0; i < BURSTS; i++) {
+		for (j = 0; j < burstSize; j++) {
+			waitInterrupt(1, &record);
+			burstLatency += read_timestamp() - record.time;
+		}
+		semaphoreSignal(deliveryAck);
+	}
+	workerDone();
+}
+
+/* bursts of button presses, each one interrupts the driver */
+void benchInterruptBursts() {
+	char name[40];
+	unsigned int start, switches;
+	int i, j;
+
+	init_button();
+	for (burstSize = 1; burstSize <= MAX_BURST; burstSize *= 4) {
+		expectWorkers(1);
+		createProcess(buttonWaiter, STACK_SIZE);
+		yield(); // the waiter blocks
+
+		switches = kernelSwitches();
+		start = read_timestamp();
+		for (i = 0; i < BURSTS; i++) {
+			for (j = 0; j < burstSize; j++) {
+				host_press_buttons(1 << (j & 3));
+			}
+			semaphoreWait(deliveryAck);
+		}
+		start = read_timestamp() - start;
+		switches = kernelSwitches() - switches;
+		waitWorkers();
+
+		sprintf(name, "irq_burst_%d", burstSize);
+		report(name, BURSTS * burstSize, start);
+		reportSwitches(name, BURSTS * burstSize, switches);
+		sprintf(name, "irq_burst_latency_%d", burstSize);
+		report(name, BURSTS * burstSize, burstLatency);
+	}
+	printf("bench irq_burst_lost count=%u\n", lostInterrupts(1));
+}
+#endif
+
+/*********************** response time under time slicing *********************/
+#define SLICED_SPINNERS	4
+#define SLICED_ROUNDS	50
+
+volatile int slicingStop;
+unsigned int responseTotal, responseMax;
+
+/* never yields, only the timer can take the processor away */
+void slicedSpinner() {
+	setQuantum(1, true);
+	while (!slicingStop);
+	workerDone();
+}
+
+/* measures how long it takes to get the processor back after a yield */
+void slicedInteractive() {
+	int i;
+	unsigned int before, response;
+
+	setQuantum(1, true);
+	responseTotal = 0;
+	responseMax = 0;
+	for (i = 0; i < SLICED_ROUNDS; i++) {
+		before = read_timestamp();
+		yield();
+		response = read_timestamp() - before;
+		responseTotal += response;
+		if (response > responseMax) {
+			responseMax = response;
+		}
+	}
+	slicingStop = 1;
+	workerDone();
+}
+
+/* response time is bounded by SLICED_SPINNERS slices of one timer tick */
+void benchTimeSlicing() {
+	int i;
+
+	slicingStop = 0;
+	expectWorkers(SLICED_SPINNERS + 1);
+	for (i = 0; i < SLICED_SPINNERS; i++) {
+		createProcess(slicedSpinner, STACK_SIZE);
+	}
+	createProcess(slicedInteractive, STACK_SIZE);
+	waitWorkers();
+	report("sliced_response", SLICED_ROUNDS, responseTotal);
+	report("sliced_response_max", 1, responseMax);
+}
+
+/*********************** earliest deadline first *********************/
+#define EDF_TASKS	3
+#define EDF_TICKS	400
+
+/* each job takes a fifth of its period and claims a quarter: 0.75 of the processor is reserved */
+int edfPeriods[EDF_TASKS] = { 10, 20, 40 };
+int edfIds[EDF_TASKS];
+unsigned int edfJobs;
+volatile int edfStop;
+unsigned int backgroundRounds;
+
+void edfJob(int task) {
+	unsigned int start = read_timestamp();
+
+	if (edfStop) {
+		workerDone();
+		processExit();
+	}
+	edfJobs++;
+	while (read_timestamp() - start < (unsigned int) edfPeriods[task] * TICK_CYCLES / 5);
+}
+
+void edfTask0() {
+	edfJob(0);
+}
+
+void edfTask1() {
+	edfJob(1);
+}
+
+void edfTask2() {
+	edfJob(2);
+}
+
+/* runs in the slack the periodic processes leave */
+void edfBackground() {
+	while (!edfStop) {
+		backgroundRounds++;
+		yield();
+	}
+	workerDone();
+}
+
+void benchEarliestDeadline() {
+	void (*tasks[EDF_TASKS])() = { edfTask0, edfTask1, edfTask2 };
+	unsigned int start, misses = 0;
+	int i, refused;
+
+	edfStop = 0;
+	edfJobs = 0;
+	backgroundRounds = 0;
+	expectWorkers(EDF_TASKS + 1);
+	for (i = 0; i < EDF_TASKS; i++) {
+		edfIds[i] = createPeriodicProcess(tasks[i], STACK_SIZE, edfPeriods[i], edfPeriods[i] / 4);
+	}
+	/* another half of the processor does not fit */
+	refused = createPeriodicProcess(edfTask0, STACK_SIZE, 10, 5) == -1;
+	createProcess(edfBackground, STACK_SIZE);
+
+	start = read_timestamp();
+	sleepTicks(EDF_TICKS);
+	start = read_timestamp() - start;
+	for (i = 0; i < EDF_TASKS; i++) {
+		misses += deadlineMisses(edfIds[i]);
+	}
+	printf("bench edf_jobs count=%u\n", edfJobs);
+	printf("bench edf_misses count=%u\n", misses);
+	printf("bench edf_refused count=%d\n", refused);
+	reportRate("edf_background", backgroundRounds, start);
+	edfStop = 1;
+	waitWorkers();
+}
+
+/*********************** throughput vs. number of cores *********************/
+#define CORE_OPS	20000
+#define CORE_WORK	2000
+
+/* mostly computes, enters the kernel once per op */
+void coreWorker() {
+	int i;
+	for (i = 0; i < CORE_OPS; i++) {
+		busyWork(CORE_WORK);
+		yield();
+	}
+	workerDone();
+}
+
+/*
+ * One worker per core in use, from 1 to KERNEL_CORES: ops_per_sec grows
+ * with the cores until the kernel lock taken by yield saturates. The idle
+ * cores take the workers from the run queue of the driver's core.
+ */
+void benchCoreScaling() {
+	char name[32];
+	unsigned int steals;
+	int n, i;
+
+	for (n = 1; n <= KERNEL_CORES; n++) {
+		steals = kernelSteals();
+		expectWorkers(n);
+		for (i = 0; i < n; i++) {
+			createProcess(coreWorker, STACK_SIZE);
+		}
+		sprintf(name, "core_scaling_%d", n);
+		reportRate(name, n * CORE_OPS, waitWorkers());
+		sprintf(name, "core_scaling_%d_steals", n);
+		printf("bench %s count=%u\n", name, kernelSteals() - steals);
+	}
+}
+
+#ifdef KERNEL_TRACE
+/*********************** trace *********************/
+/* the kernel takes a record or a few per operation, compare with a build without the trace */
+void benchTrace() {
+	unsigned int start;
+	int i;
+
+	start = read_timestamp();
+	for (i = 0; i < ROUNDS; i++) {
+		TRACE(TRACE_EVENT_FIRE, i, 0);
+	}
+	report("trace_record", ROUNDS, read_timestamp() - start);
+}
+#endif
+
+/*********************** boot and memory *********************/
+#ifdef __nios2__
+/* from the linker script of the BSP */
+extern char __ram_rwdata_start[], __ram_rwdata_end[], __bss_start[], __bss_end[];
+#define DATA_START	__ram_rwdata_start
+#define DATA_END	__ram_rwdata_end
+#define BSS_START	__bss_start
+#define BSS_END		__bss_end
+#ifdef KERNEL_ONCHIP
+/* from onchip.ld */
+extern char _kernel_onchip_start[], _kernel_onchip_end[];
+#endif
+#else
+extern char __data_start[], _edata[], __bss_start[], _end[];
+#define DATA_START	__data_start
+#define DATA_END	_edata
+#define BSS_START	__bss_start
+#define BSS_END		_end
+#endif
+
+/* from the first line of main() to the first line of the driver */
+unsigned int bootStart, bootCycles;
+
+void reportMemory() {
+	report("boot", 1, bootCycles);
+	printf("bench data_size bytes=%u\n", (unsigned int) (DATA_END - DATA_START));
+	printf("bench bss_size bytes=%u\n", (unsigned int) (BSS_END - BSS_START));
+	printf("bench heap_usage bytes=%u\n", kernelHeapUsage());
+#if defined(__nios2__) && defined(KERNEL_ONCHIP)
+	printf("bench onchip_size bytes=%u\n", (unsigned int) (_kernel_onchip_end - _kernel_onchip_start));
+#endif
+}
+
+void driver() {
+	int i;
+
+	bootCycles = read_timestamp() - bootStart;
+
+	expectWorkers(2);
+	createProcess(pingPong, STACK_SIZE);
+	createProcess(pingPong, STACK_SIZE);
+	report("yield_pingpong", 2 * ROUNDS, waitWorkers());
+
+	expectWorkers(2);
+	createProcess(handoffProducer, STACK_SIZE);
+	createProcess(handoffConsumer, STACK_SIZE);
+	report("monitor_handoff", ROUNDS, waitWorkers());
+
+	benchBufferThroughput();
+	benchEventBufferThroughput();
+	benchChannelThroughput();
+	benchNestedMonitors();
+	benchReaders();
+	benchEventDelivery();
+
+	expectWorkers(WORKERS);
+	for (i = 0; i < WORKERS; i++) {
+		createProcess(yielder, STACK_SIZE);
+	}
+	report("yield_throughput", WORKERS * ROUNDS, waitWorkers());
+
+	benchYieldScaling();
+	benchDispatchLatency();
+	benchPriorityInversion();
+	benchProcessChurn();
+	benchFirstRun();
+	benchTransfer();
+	benchTasks();
+	benchCoreScaling();
+#if !defined(__nios2__) && KERNEL_CORES == 1
+	benchInterruptBursts();
+#endif
+
+	/* the timer benchmarks come last, the tick disturbs the others */
+	init_clock();
+	benchTimers();
+	benchIdle();
+	benchTimeSlicing();
+	benchEarliestDeadline();
+
+	reportMemory();
+#ifdef KERNEL_STACK_CHECK
+	printf("bench worker_stack_high_water bytes=%d\n", workerStackUsed);
+#endif
+#ifdef KERNEL_TRACE
+	traceDump();
+	benchTrace();
+#endif
+#ifdef KERNEL_STATS
+	statsDump();
+#endif
+	exit(0);
+}
+
+int main() {
+	init_timestamp();
+	bootStart = read_timestamp();
+#ifdef KERNEL_STATIC
+	doneEvent = DONE_EVENT;
+	fireEvent = FIRE_EVENT;
+	doneMonitor = DONE_MONITOR;
+	inversionMonitor = INVERSION_MONITOR;
+	inversionEvent = INVERSION_EVENT;
+	buffer.monitor = BUFFER_MONITOR;
+	buffer.full = 0;
+	eventBuffer.emptyEvent = EMPTY_EVENT;
+	eventBuffer.fullEvent = FULL_EVENT;
+	declencher(eventBuffer.emptyEvent);
+	dummyMonitor1 = DUMMY_MONITOR_1;
+	dummyMonitor2 = DUMMY_MONITOR_2;
+	tableMonitor = TABLE_MONITOR;
+	deliveryEvents[0] = MANUAL_DELIVERY_EVENT;
+	deliveryEvents[1] = AUTO_DELIVERY_EVENT;
+	spscChannel = SPSC_CHANNEL;
+	mpmcChannel = MPMC_CHANNEL;
+#else
+	doneEvent = createEvent();
+	fireEvent = createEvent();
+	doneMonitor = createMonitor();
+	inversionMonitor = createMonitor();
+	inversionEvent = createEvent();
+	initBuffer(&buffer);
+	initEventBuffer(&eventBuffer);
+	dummyMonitor1 = createMonitor();
+	dummyMonitor2 = createMonitor();
+	tableMonitor = createMonitor();
+	deliveryEvents[0] = createEventWithMode(EVENT_MANUAL_RESET);
+	deliveryEvents[1] = createEventWithMode(EVENT_AUTO_RESET);
+	spscChannel = createChannel(CHANNEL_CAPACITY, true);
+	mpmcChannel = createChannel(CHANNEL_CAPACITY, false);
+
+	createProcess(driver, STACK_SIZE);
+#endif
+	/* semaphores and reader-writer locks are not part of the static configuration */
+	tableLock = createRWLock(true);
+	deliveryAck = createSemaphore(0);
+	start();
+	return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef KERNEL_CONFIG_H_
+#define KERNEL_CONFIG_H_
+
+/*
+ * Static configuration of kernelBench.c, used when the kernel is built with
+ * -DKERNEL_STATIC (see kernelStatic.h). The benchmarks create their workers
+ * at run time, only the driver is static.
+ */
+
+#define KERNEL_PROCESSES(P) \
+    P(DRIVER_PROCESS, driver, 16384, DEFAULT_PRIORITY)
+
+#define KERNEL_MONITORS(M) \
+    M(DONE_MONITOR) \
+    M(INVERSION_MONITOR) \
+    M(BUFFER_MONITOR) \
+    M(DUMMY_MONITOR_1) \
+    M(DUMMY_MONITOR_2) \
+    M(TABLE_MONITOR)
+
+#define KERNEL_EVENTS(E) \
+    E(DONE_EVENT, EVENT_MANUAL_RESET) \
+    E(FIRE_EVENT, EVENT_MANUAL_RESET) \
+    E(INVERSION_EVENT, EVENT_MANUAL_RESET) \
+    E(MANUAL_DELIVERY_EVENT, EVENT_MANUAL_RESET) \
+    E(AUTO_DELIVERY_EVENT, EVENT_AUTO_RESET) \
+    E(EMPTY_EVENT, EVENT_AUTO_RESET) \
+    E(FULL_EVENT, EVENT_AUTO_RESET)
+
+#define KERNEL_CHANNELS(C) \
+    C(SPSC_CHANNEL, 64, true) \
+    C(MPMC_CHANNEL, 64, false)
+
+#include "kernelStatic.h"
+
+#endif /*KERNEL_CONFIG_H_*/
@@ -0,0 +1,49 @@
+#ifndef KERNEL_STATIC_H_
+#define KERNEL_STATIC_H_
+
+#include "kernel.h"
+#include "onchip.h"
+
+/*
+ * Static configuration, used when the kernel is built with -DKERNEL_STATIC.
+ * The application lists its processes, monitors, events and channels in a
+ * kernelConfig.h on the include path, which ends by including this file:
+ *
+ *   #define KERNEL_PROCESSES(P) P(NAME, entry, stackSize, priority[, placement]) ...
+ *   #define KERNEL_MONITORS(M)  M(NAME) ...
+ *   #define KERNEL_EVENTS(E)    E(NAME, mode) ...
+ *   #define KERNEL_CHANNELS(C)  C(NAME, capacity, single) ...
+ *
+ * Each NAME becomes the id of its object. kernel.c builds the descriptors,
+ * stacks and channel rings in .data and .bss, so that no create call nor
+ * malloc is needed to boot; start() only lays out the first frame of each
+ * process and fills the ready lists. Channel capacities must be powers of
+ * two. More objects can still be created at run time. The optional
+ * placement of a process is an attribute of its stack: ONCHIP_DATA puts a
+ * small stack in the on-chip memory with -DKERNEL_ONCHIP (see onchip.h).
+ */
+
+#ifndef KERNEL_PROCESSES
+#define KERNEL_PROCESSES(P)
+#endif
+#ifndef KERNEL_MONITORS
+#define KERNEL_MONITORS(M)
+#endif
+#ifndef KERNEL_EVENTS
+#define KERNEL_EVENTS(E)
+#endif
+#ifndef KERNEL_CHANNELS
+#define KERNEL_CHANNELS(C)
+#endif
+
+#define STATIC_ID(name, ...) name,
+#define STATIC_ENTRY(name, entry, ...) void entry();
+
+enum { KERNEL_PROCESSES(STATIC_ID) STATIC_PROCESSES };
+enum { KERNEL_MONITORS(STATIC_ID) STATIC_MONITORS };
+enum { KERNEL_EVENTS(STATIC_ID) STATIC_EVENTS };
+enum { KERNEL_CHANNELS(STATIC_ID) STATIC_CHANNELS };
+
+KERNEL_PROCESSES(STATIC_ENTRY)
+
+#endif /*KERNEL_STATIC_H_*/
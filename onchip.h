@@ -0,0 +1,25 @@
+#ifndef ONCHIP_H_
+#define ONCHIP_H_
+
+/*
+ * Placement of the kernel hot paths, built with -DKERNEL_ONCHIP: the
+ * switch, scheduler, timer and interrupt routines go in .kernel_onchip.text
+ * and the ready lists, timer wheel, monitors, events and interrupt rings in
+ * .kernel_onchip.data, which onchip.ld maps to onchip_mem (16 KB, no wait
+ * state) instead of the SDRAM. asm.s moves the switch routines too when
+ * assembled with --defsym KERNEL_ONCHIP=1. Without the flag both macros
+ * expand to nothing and the default linker script places everything.
+ *
+ * Variables smaller than the -G limit are left to .sdata and .sbss: in
+ * another section they lose their gp-relative addressing.
+ */
+
+#ifdef KERNEL_ONCHIP
+#define ONCHIP_CODE __attribute__((section(".kernel_onchip.text")))
+#define ONCHIP_DATA __attribute__((section(".kernel_onchip.data")))
+#else
+#define ONCHIP_CODE
+#define ONCHIP_DATA
+#endif
+
+#endif /*ONCHIP_H_*/
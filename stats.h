@@ -0,0 +1,52 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdbool.h>
+
+/*
+ * Kernel statistics, compiled in with -DKERNEL_STATS. Times are timer_1
+ * clock cycles (TIMER_1_FREQ) and need init_timestamp().
+ */
+
+// Bucket 0 of a latency histogram counts the latencies below 2^LATENCY_SHIFT
+// cycles, bucket i those below 2^(LATENCY_SHIFT + i), the last one the others
+#define LATENCY_SHIFT 6
+#define LATENCY_BUCKETS 16
+
+typedef struct {
+    unsigned int voluntarySwitches; // the process blocked, yielded or exited
+    unsigned int involuntarySwitches; // preempted by a better process, the end of its slice or an interrupt
+    unsigned long long runningCycles;
+    unsigned long long readyCycles;
+    unsigned long long blockedCycles;
+    unsigned int wakeups; // times it was made ready after being blocked
+    unsigned int latency[LATENCY_BUCKETS]; // cycles from a wakeup to running
+} ProcessStats;
+
+typedef struct {
+    unsigned int entries; // outermost entries, returns from wait included
+    unsigned int contentions; // entries that had to queue
+    unsigned long long holdCycles; // time the monitor had an owner
+    unsigned int maxHoldCycles;
+} MonitorStats;
+
+typedef struct {
+    unsigned int waits; // calls to attendre that blocked
+    unsigned int fires;
+} EventStats;
+
+#ifdef KERNEL_STATS
+
+/* They return false if the process has exited or the id is invalid. */
+bool getProcessStats(int processId, ProcessStats* stats);
+
+bool getMonitorStats(int monitorId, MonitorStats* stats);
+
+bool getEventStats(int eventID, EventStats* stats);
+
+/* Prints one line per live process, monitor and event. */
+void statsDump();
+
+#endif
+
+#endif /*STATS_H_*/
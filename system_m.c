@@ -3,15 +3,16 @@
 #include "system_m.h"
 #include "assembly.h"
 #include "interrupt.h"
+#include "onchip.h"
 
 
-Process running = NULL;  // pointer to the current process.
-Process nextP = NULL;  // variable used internally to implement transfer and iotransfer procedures
+CORE_LOCAL Process running = NULL;  // pointer to the current process.
+CORE_LOCAL Process nextP = NULL;  // variable used internally to implement transfer and iotransfer procedures
 
 Process newProcess(void (*f), unsigned int* stack, int stackSize){
     
     unsigned int* newPC = f;
-    int size = stackSize - 4;
+    int size = stackSize - sizeof(struct ProcessContext);
     
     Process process = _createStack(stack,newPC,size);
     return process;
@@ -21,24 +22,40 @@ Process newProcess(void (*f), unsigned int* stack, int stackSize){
  * Called mainly from interrupt routine.
  * (Except for the first call)
  */
-void transfer(Process p){
+ONCHIP_CODE void transfer(Process p){
     
     if(running == NULL){
-        running = malloc(sizeof(Process));
+        running = malloc(sizeof(struct ProcessContext));
     }
     nextP = p ;
     _transfer();
    
 }
 
+/**
+ * Called from kernel thread, saves only the callee-saved registers.
+ */
+ONCHIP_CODE void transferVoluntary(Process p){
+    
+    if(running == NULL){
+        running = malloc(sizeof(struct ProcessContext));
+    }
+    nextP = p ;
+    _transferVoluntary();
+   
+}
+
 /**
  * Called from kernel thread.
  */
 void iotransfer(Process p, int interruptV){
     
+    // the ISR of interruptV must not see a half linked wait queue
+    int status = disableInterrupts();
     insertTail(interruptV, running);
     nextP = p;
-    _transfer();
+    _transferVoluntary();
+    restoreInterrupts(status);
    
 }
     
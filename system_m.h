@@ -1,7 +1,33 @@
 #ifndef SYSTEM_M_H_
 #define SYSTEM_M_H_
 
-typedef unsigned int *Process;
+/*
+    Number of processors that run processes, each one with its own running process. Only the hosted
+    build, where they are threads, supports more than one.
+ */
+#ifndef KERNEL_CORES
+#define KERNEL_CORES 1
+#endif
+
+/* Storage class of the variables each processor has its own copy of. */
+#ifdef __nios2__
+#if KERNEL_CORES > 1
+#error "The Nios II port runs on a single core, build the hosted one for KERNEL_CORES > 1"
+#endif
+#define CORE_LOCAL
+#else
+#define CORE_LOCAL __thread
+#endif
+
+/*
+    A process is designated by its context block, which sits at the bottom of its stack (highest
+    addresses). It holds the saved stack pointer, which must stay the first field since _transfer
+    uses it, and the link used to queue the process on an interrupt vector without allocating.
+ */
+typedef struct ProcessContext {
+    void* sp;
+    struct ProcessContext* ioNext;
+} *Process;
 
 
 /* 
@@ -20,6 +46,12 @@ Process newProcess(void (*f), unsigned int* stack, int stackSize);
 */
 void transfer(Process p);
 
+/*
+   Same as transfer, for a switch that does not originate in an interrupt routine: only the callee-saved
+   registers are saved. Either kind of switch can resume a process suspended by the other one.
+*/
+void transferVoluntary(Process p);
+
 
 /*
     This procedure registers that active process waits on interrupt interruptV, suspends active process and
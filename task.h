@@ -0,0 +1,94 @@
+#ifndef TASK_H_
+#define TASK_H_
+
+#include <stdbool.h>
+#include "kernel.h"
+
+/*
+ * Stackless tasks, for the many small state machines that do not need a
+ * process of their own. A task is a function resumed where it last
+ * blocked: its locals are lost when it blocks, its state goes in a struct
+ * that starts with the Task, e.g.
+ *
+ *   typedef struct { Task task; int count; } Blinker;
+ *
+ *   int blink(Task* t) {
+ *       Blinker* b = (Blinker*) t;
+ *       TASK_BEGIN(t);
+ *       for (b->count = 0; b->count < 10; b->count++) {
+ *           TASK_ATTENDRE(t, buttonEvent);
+ *           TASK_SLEEP(t, 100);
+ *       }
+ *       TASK_END(t);
+ *   }
+ *
+ * The tasks of a priority are run one after the other by a kernel process
+ * of that priority, created with the first of them: resuming one is a
+ * function call on the stack of that process. Only the TASK_ macros block
+ * a task, at most one per line and not inside a switch statement of its
+ * own. A task leaves its monitor before it blocks, except in TASK_WAIT,
+ * and does not nest monitors. Tasks do not keep the program running once
+ * all the processes have exited.
+ */
+
+// What the function of a task returns
+#define TASK_BLOCKED 0
+#define TASK_DONE 1
+#define TASK_YIELDED 2
+
+typedef struct Task {
+    int (*run)(struct Task* task); // returns TASK_BLOCKED, TASK_DONE or TASK_YIELDED
+    struct Task* next; // link of the list the task is in
+    int line; // where run resumes, 0 to start from the beginning
+    int priority; // priority of the process that runs it
+    int monitor; // monitor of the last TASK_WAIT
+    unsigned int timerExpiry; // tick at which TASK_SLEEP ends
+} Task;
+
+/* Both make the task ready, its state must have been initialized. */
+void createTask(Task* task, int (*run)(Task*));
+
+void createTaskWithPriority(Task* task, int (*run)(Task*), int priority);
+
+// Marks the resume points the code before them falls into, for -Wimplicit-fallthrough
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define TASK_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define TASK_FALLTHROUGH
+#endif
+
+#define TASK_BEGIN(t) switch ((t)->line) { case 0:
+
+#define TASK_END(t) } (t)->line = 0; return TASK_DONE
+
+/* Gives the processor to the other ready tasks. */
+#define TASK_YIELD(t) \
+    do { (t)->line = __LINE__; return TASK_YIELDED; case __LINE__: ; } while (0)
+
+/* Same as attendre: an auto-reset event is taken when the task is woken up. */
+#define TASK_ATTENDRE(t, eventID) \
+    do { (t)->line = __LINE__; if (!taskAttendre((t), (eventID))) return TASK_BLOCKED; TASK_FALLTHROUGH; case __LINE__: ; } while (0)
+
+/* Same as sleepTicks, needs init_clock(). */
+#define TASK_SLEEP(t, ticks) \
+    do { (t)->line = __LINE__; if (!taskSleep((t), (ticks))) return TASK_BLOCKED; TASK_FALLTHROUGH; case __LINE__: ; } while (0)
+
+/* Same as enterMonitor, leave it with exitMonitor(). The owner does not inherit the priority of the task. */
+#define TASK_ENTER(t, monitorID) \
+    do { (t)->line = __LINE__; TASK_FALLTHROUGH; case __LINE__: if (!taskEnter((t), (monitorID))) return TASK_BLOCKED; } while (0)
+
+/* Same as wait, notify() and notifyAll() wake the waiting processes before the tasks. */
+#define TASK_WAIT(t) \
+    do { (t)->line = __LINE__; taskWait(t); return TASK_BLOCKED; \
+         case __LINE__: if (!taskEnter((t), (t)->monitor)) return TASK_BLOCKED; } while (0)
+
+/* Used by the macros: they return false if the task has to block. */
+bool taskAttendre(Task* task, int eventID);
+
+bool taskSleep(Task* task, int ticks);
+
+bool taskEnter(Task* task, int monitorID);
+
+void taskWait(Task* task);
+
+#endif /*TASK_H_*/
@@ -0,0 +1,85 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/*
+ * Kernel trace, compiled in with -DKERNEL_TRACE. The last TRACE_SIZE kernel
+ * events are kept in traceBuffer with a timer_1 timestamp, older ones are
+ * overwritten. Either dump the memory of traceBuffer (it starts with
+ * TRACE_MAGIC) or print it with traceDump(), then feed it to
+ * host/traceDecode.c to get a Chrome trace.
+ */
+
+// Kinds of records, the meaning of process and arg is given for each
+enum {
+    TRACE_SWITCH,        // running process, process switched to
+    TRACE_ENQUEUE,       // process added to a list, address of the list
+    TRACE_DEQUEUE,       // process removed from a list, address of the list
+    TRACE_SPLICE,        // head of the processes moved to a list, address of the list
+    TRACE_MONITOR_ENTER, // running process, monitor
+    TRACE_MONITOR_BLOCK, // running process, monitor it queues on
+    TRACE_MONITOR_WAIT,  // running process, monitor it waits in
+    TRACE_MONITOR_EXIT,  // running process, monitor
+    TRACE_EVENT_FIRE,    // running process, event
+    TRACE_ISR_ENTER,     // running process, interrupt number
+    TRACE_ISR_EXIT,      // running process, interrupt number
+    TRACE_TYPES
+};
+
+// Number of records kept, a power of two
+#ifndef TRACE_SIZE
+#define TRACE_SIZE 1024
+#endif
+
+// First word of traceBuffer, "TRAC" in little-endian memory
+#define TRACE_MAGIC 0x43415254
+
+typedef struct {
+    unsigned int time; // timer_1 cycles since init_timestamp, wraps around
+    unsigned int type;
+    int process;
+    unsigned int arg;
+} TraceRecord;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int size;      // TRACE_SIZE
+    unsigned int frequency; // of the timestamps
+    unsigned int next;      // number of records written so far
+    TraceRecord records[TRACE_SIZE];
+} TraceBuffer;
+
+#ifdef KERNEL_TRACE
+
+#include <stdint.h>
+#include "interrupt.h"
+
+extern TraceBuffer traceBuffer;
+
+/*
+ * Called with interrupts disabled, except on the monitor fast paths where
+ * an interrupt may take the same slot: one of the two records is lost.
+ */
+static inline void traceRecord(unsigned int type, int process, unsigned int arg)
+{
+    TraceRecord *r = &(traceBuffer.records[traceBuffer.next++ & (TRACE_SIZE - 1)]);
+    r->time = read_timestamp();
+    r->type = type;
+    r->process = process;
+    r->arg = arg;
+}
+
+#define TRACE(type, process, arg) traceRecord((type), (process), (unsigned int) (uintptr_t) (arg))
+
+/* Prints the records as text lines, the oldest first, for traceDecode. */
+void traceDump();
+
+/* Slab index of the running process, -1 before start(), for the interrupt routines. */
+int traceProcess();
+
+#else
+
+#define TRACE(type, process, arg)
+
+#endif
+
+#endif /*TRACE_H_*/